@@ -31,6 +31,7 @@
 #include "actions.h"
 #include "charset.h"
 #include "config.h"
+#include "database_cache.h"
 #include "display.h"
 #include "global.h"
 #include "mpdpp.h"
@@ -1780,13 +1781,13 @@ bool SelectItem::canBeRun()
 	m_list = dynamic_cast<NC::List *>(myScreen->activeWindow());
 	return m_list != nullptr
 	    && !m_list->empty()
-	    && m_list->currentP()->isSelectable();
+	    && m_list->currentProperties().isSelectable();
 }
 
 void SelectItem::run()
 {
-	auto current = m_list->currentP();
-	current->setSelected(!current->isSelected());
+	auto &current = m_list->currentProperties();
+	current.setSelected(!current.isSelected());
 }
 
 bool SelectRange::canBeRun()
@@ -1794,15 +1795,12 @@ bool SelectRange::canBeRun()
 	m_list = dynamic_cast<NC::List *>(myScreen->activeWindow());
 	if (m_list == nullptr)
 		return false;
-	m_begin = m_list->beginP();
-	m_end = m_list->endP();
-	return findRange(m_begin, m_end);
+	return m_list->selectedRange(m_first, m_last);
 }
 
 void SelectRange::run()
 {
-	for (; m_begin != m_end; ++m_begin)
-		m_begin->setSelected(true);
+	m_list->setSelected(m_first, m_last, true);
 	Statusbar::print("Range selected");
 }
 
@@ -1814,8 +1812,7 @@ bool ReverseSelection::canBeRun()
 
 void ReverseSelection::run()
 {
-	for (auto &p : *m_list)
-		p.setSelected(!p.isSelected());
+	m_list->reverseSelection();
 	Statusbar::print("Selection reversed");
 }
 
@@ -1827,8 +1824,7 @@ bool RemoveSelection::canBeRun()
 
 void RemoveSelection::run()
 {
-	for (auto &p : *m_list)
-		p.setSelected(false);
+	m_list->setSelected(0, m_list->size(), false);
 	Statusbar::print("Selection removed");
 }
 
@@ -1845,28 +1841,24 @@ bool SelectAlbum::canBeRun()
 
 void SelectAlbum::run()
 {
-	const auto front = m_songs->beginS(), current = m_songs->currentS(), end = m_songs->endS();
-	if (current->song() == nullptr)
+	const size_t current = m_list->choice(), size = m_list->size();
+	const MPD::Song *s = m_songs->songAt(current);
+	if (s == nullptr)
 		return;
 	auto get = &MPD::Song::getAlbum;
-	const std::string tag = current->song()->getTags(get);
+	const std::string tag = s->getTags(get);
+	auto has_tag = [this, &get, &tag](size_t pos) {
+		const MPD::Song *song = m_songs->songAt(pos);
+		return song != nullptr && song->getTags(get) == tag;
+	};
+	size_t first = current, last = current+1;
 	// go up
-	for (auto it = current; it != front;)
-	{
-		--it;
-		if (it->song() == nullptr || it->song()->getTags(get) != tag)
-			break;
-		it->properties().setSelected(true);
-	}
+	while (first > 0 && has_tag(first-1))
+		--first;
 	// go down
-	for (auto it = current;;)
-	{
-		it->properties().setSelected(true);
-		if (++it == end)
-			break;
-		if (it->song() == nullptr || it->song()->getTags(get) != tag)
-			break;
-	}
+	while (last < size && has_tag(last))
+		++last;
+	m_list->setSelected(first, last, true);
 	Statusbar::print("Album around cursor position selected");
 }
 
@@ -1887,9 +1879,9 @@ void SelectFoundItems::run()
 	if (found)
 	{
 		Statusbar::print("Searching for items...");
-		m_list->currentP()->setSelected(true);
+		m_list->currentProperties().setSelected(true);
 		while (m_searchable->search(SearchDirection::Forward, false, true))
-			m_list->currentP()->setSelected(true);
+			m_list->currentProperties().setSelected(true);
 		Statusbar::print("Found items selected");
 	}
 	m_list->highlight(current_pos);
@@ -2032,6 +2024,14 @@ void ApplyFilter::run()
 		throw;
 	}
 
+	// Filtering might have been interrupted by the last key press.
+	try
+	{
+		if (m_filterable->currentFilter() != filter)
+			m_filterable->applyFilter(filter);
+	}
+	catch (boost::bad_expression &) { }
+
 	if (filter.empty())
 		Statusbar::printf("Filtering disabled");
 	else
@@ -2234,7 +2234,17 @@ void AddRandomItems::run()
 	{
 		bool success;
 		if (rnd_type == 's')
-			success = Mpd.AddRandomSongs(number, Config.random_exclude_pattern, Global::RNG);
+		{
+			auto paths = DatabaseCache::randomPaths(number, Global::RNG);
+			success = paths.size() == number;
+			if (success)
+			{
+				Mpd.StartCommandsList();
+				for (const auto &path : paths)
+					Mpd.AddSong(path);
+				Mpd.CommitCommandsList();
+			}
+		}
 		else
 			success = Mpd.AddRandomTag(tag_type, number, Global::RNG);
 		if (success)
@@ -2891,35 +2901,38 @@ bool scrollTagCanBeRun(NC::List *&list, const SongList *&songs)
 
 void scrollTagUpRun(NC::List *list, const SongList *songs, MPD::Song::GetFunction get)
 {
-	const auto front = songs->beginS();
-	auto it = songs->currentS();
-	if (it->song() != nullptr)
+	size_t pos = list->choice();
+	const MPD::Song *s = songs->songAt(pos);
+	if (s != nullptr)
 	{
-		const std::string tag = it->song()->getTags(get);
-		while (it != front)
+		const std::string tag = s->getTags(get);
+		while (pos > 0)
 		{
-			--it;
-			if (it->song() == nullptr || it->song()->getTags(get) != tag)
+			--pos;
+			s = songs->songAt(pos);
+			if (s == nullptr || s->getTags(get) != tag)
 				break;
 		}
-		list->highlight(it-front);
+		list->highlight(pos);
 	}
 }
 
 void scrollTagDownRun(NC::List *list, const SongList *songs, MPD::Song::GetFunction get)
 {
-	const auto front = songs->beginS(), back = --songs->endS();
-	auto it = songs->currentS();
-	if (it->song() != nullptr)
+	size_t pos = list->choice();
+	const size_t back = list->size()-1;
+	const MPD::Song *s = songs->songAt(pos);
+	if (s != nullptr)
 	{
-		const std::string tag = it->song()->getTags(get);
-		while (it != back)
+		const std::string tag = s->getTags(get);
+		while (pos != back)
 		{
-			++it;
-			if (it->song() == nullptr || it->song()->getTags(get) != tag)
+			++pos;
+			s = songs->songAt(pos);
+			if (s == nullptr || s->getTags(get) != tag)
 				break;
 		}
-		list->highlight(it-front);
+		list->highlight(pos);
 	}
 }
 
@@ -947,8 +947,8 @@ private:
 	virtual void run() override;
 
 	NC::List *m_list;
-	NC::List::Iterator m_begin;
-	NC::List::Iterator m_end;
+	size_t m_first;
+	size_t m_last;
 };
 
 struct ReverseSelection: BaseAction
@@ -21,6 +21,8 @@
 #include "curl_handle.h"
 
 #include <cstdlib>
+#include <mutex>
+#include <vector>
 
 namespace
 {
@@ -30,23 +32,106 @@ namespace
 		static_cast<std::string *>(data)->append(buffer, result);
 		return result;
 	}
+
+	// Handles are reused, so that they keep their connections alive between
+	// requests. They also share DNS and TLS session caches. The connection
+	// cache is not shared as libcurl doesn't support that between threads
+	// running transfers at the same time.
+	struct HandlePool
+	{
+		HandlePool()
+		{
+			curl_global_init(CURL_GLOBAL_DEFAULT);
+			m_share = curl_share_init();
+			curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, lock);
+			curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, unlock);
+			curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+			curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+			curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		}
+
+		CURL *acquire()
+		{
+			CURL *c = nullptr;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_handles.empty())
+				{
+					c = m_handles.back();
+					m_handles.pop_back();
+				}
+			}
+			if (c == nullptr)
+				c = curl_easy_init();
+			else
+				curl_easy_reset(c);
+			curl_easy_setopt(c, CURLOPT_SHARE, m_share);
+			return c;
+		}
+
+		void release(CURL *c)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_handles.size() < max_handles)
+				{
+					m_handles.push_back(c);
+					return;
+				}
+			}
+			curl_easy_cleanup(c);
+		}
+
+	private:
+		// Enough for concurrent fetching of lyrics from all sources.
+		static const size_t max_handles = 16;
+
+		static void lock(CURL *, curl_lock_data data, curl_lock_access, void *pool)
+		{
+			static_cast<HandlePool *>(pool)->m_share_mutexes[data].lock();
+		}
+
+		static void unlock(CURL *, curl_lock_data data, void *pool)
+		{
+			static_cast<HandlePool *>(pool)->m_share_mutexes[data].unlock();
+		}
+
+		std::mutex m_mutex;
+		std::vector<CURL *> m_handles;
+
+		CURLSH *m_share;
+		std::mutex m_share_mutexes[CURL_LOCK_DATA_LAST];
+	};
+
+	HandlePool &handlePool()
+	{
+		// Never destroyed, detached threads may still be using it at exit.
+		static HandlePool *pool = new HandlePool;
+		return *pool;
+	}
+
+	CURL *createHandle(std::string &data, const std::string &URL, const std::string &referer, bool follow_redirect, unsigned timeout)
+	{
+		CURL *c = handlePool().acquire();
+		curl_easy_setopt(c, CURLOPT_URL, URL.c_str());
+		curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, write_data);
+		curl_easy_setopt(c, CURLOPT_WRITEDATA, &data);
+		curl_easy_setopt(c, CURLOPT_CONNECTTIMEOUT, timeout);
+		curl_easy_setopt(c, CURLOPT_NOSIGNAL, 1);
+		if (follow_redirect)
+			curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
+		if (!referer.empty())
+			curl_easy_setopt(c, CURLOPT_REFERER, referer.c_str());
+		return c;
+	}
 }
 
 CURLcode Curl::perform(std::string &data, const std::string &URL, const std::string &referer, bool follow_redirect, unsigned timeout)
 {
 	CURLcode result;
-	CURL *c = curl_easy_init();
-	curl_easy_setopt(c, CURLOPT_URL, URL.c_str());
-	curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, write_data);
-	curl_easy_setopt(c, CURLOPT_WRITEDATA, &data);
-	curl_easy_setopt(c, CURLOPT_CONNECTTIMEOUT, timeout);
-	curl_easy_setopt(c, CURLOPT_NOSIGNAL, 1);
-	if (follow_redirect)
-		curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
-	if (!referer.empty())
-		curl_easy_setopt(c, CURLOPT_REFERER, referer.c_str());
+	CURL *c = createHandle(data, URL, referer, follow_redirect, timeout);
 	result = curl_easy_perform(c);
-	curl_easy_cleanup(c);
+	handlePool().release(c);
 	return result;
 }
 
@@ -57,3 +142,64 @@ std::string Curl::escape(const std::string &s)
 	curl_free(cs);
 	return result;
 }
+
+Curl::Multi::Multi()
+: m_handle(curl_multi_init())
+{ }
+
+Curl::Multi::~Multi()
+{
+	while (!m_transfers.empty())
+		remove(m_transfers.begin());
+	curl_multi_cleanup(m_handle);
+}
+
+void Curl::Multi::add(Callback callback, const std::string &URL, const std::string &referer, bool follow_redirect, unsigned timeout)
+{
+	m_transfers.emplace_back();
+	auto &transfer = m_transfers.back();
+	transfer.callback = std::move(callback);
+	transfer.handle = createHandle(transfer.data, URL, referer, follow_redirect, timeout);
+	curl_easy_setopt(transfer.handle, CURLOPT_PRIVATE, &transfer);
+	curl_multi_add_handle(m_handle, transfer.handle);
+}
+
+void Curl::Multi::run(const std::function<bool()> &stop)
+{
+	int running;
+	while (!m_transfers.empty() && !stop())
+	{
+		if (curl_multi_perform(m_handle, &running) != CURLM_OK)
+			break;
+
+		CURLMsg *msg;
+		int messages;
+		while ((msg = curl_multi_info_read(m_handle, &messages)) != nullptr)
+		{
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			void *finished;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &finished);
+			CURLcode code = msg->data.result;
+			auto transfer = m_transfers.begin();
+			while (&*transfer != finished)
+				++transfer;
+			Callback callback = std::move(transfer->callback);
+			std::string data = std::move(transfer->data);
+			remove(transfer);
+			callback(code, data);
+			if (stop())
+				return;
+		}
+
+		if (!m_transfers.empty())
+			curl_multi_wait(m_handle, nullptr, 0, 100, nullptr);
+	}
+}
+
+void Curl::Multi::remove(std::list<Transfer>::iterator transfer)
+{
+	curl_multi_remove_handle(m_handle, transfer->handle);
+	handlePool().release(transfer->handle);
+	m_transfers.erase(transfer);
+}
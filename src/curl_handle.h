@@ -23,6 +23,8 @@
 
 #include "config.h"
 
+#include <functional>
+#include <list>
 #include <string>
 #include "curl/curl.h"
 
@@ -31,6 +33,40 @@ namespace Curl
 	CURLcode perform(std::string &data, const std::string &URL, const std::string &referer = "", bool follow_redirect = false, unsigned timeout = 10);
 	
 	std::string escape(const std::string &s);
+
+	// Event loop performing multiple transfers concurrently.
+	struct Multi
+	{
+		typedef std::function<void(CURLcode, std::string &)> Callback;
+
+		Multi();
+		~Multi();
+
+		Multi(const Multi &) = delete;
+		Multi &operator=(const Multi &) = delete;
+
+		// Add a transfer, callback is called with its result and the received
+		// data once it's finished. It's fine to add transfers from callbacks.
+		void add(Callback callback, const std::string &URL, const std::string &referer = "", bool follow_redirect = false, unsigned timeout = 10);
+
+		// Perform transfers until all of them are finished or stop returns
+		// true. Unfinished transfers are aborted then. Stop is checked after each
+		// finished transfer and at least every 100 milliseconds.
+		void run(const std::function<bool()> &stop);
+
+	private:
+		struct Transfer
+		{
+			CURL *handle;
+			std::string data;
+			Callback callback;
+		};
+
+		void remove(std::list<Transfer>::iterator transfer);
+
+		CURLM *m_handle;
+		std::list<Transfer> m_transfers;
+	};
 }
 
 #endif // NCMPCPP_CURL_HANDLE_H
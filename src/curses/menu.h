@@ -28,14 +28,50 @@
 #include <iterator>
 #include <memory>
 #include <set>
+#include <type_traits>
+#include <vector>
 
 #include "curses/formatted_color.h"
 #include "curses/strbuffer.h"
 #include "curses/window.h"
 #include "utility/const.h"
+#include "utility/thread_pool.h"
 
 namespace NC {
 
+/// Thrown if Menu::applyFilter was interrupted by the filter interrupt hook
+/// @see ScopedFilterInterruptHook
+struct FilterInterrupted : std::exception
+{
+	virtual const char *what() const noexcept override { return "filtering interrupted"; }
+};
+
+/// Predicate periodically checked while Menu::applyFilter is in progress. If
+/// it returns true, filtering is stopped and FilterInterrupted is thrown.
+typedef std::function<bool()> FilterInterruptHook;
+
+inline FilterInterruptHook &filterInterruptHook()
+{
+	static FilterInterruptHook hook;
+	return hook;
+}
+
+/// Sets filter interrupt hook for the current scope
+struct ScopedFilterInterruptHook
+{
+	template <typename HookT>
+	ScopedFilterInterruptHook(HookT &&hook) noexcept
+	: m_hook(std::move(filterInterruptHook())) {
+		filterInterruptHook() = std::forward<HookT>(hook);
+	}
+	~ScopedFilterInterruptHook() noexcept {
+		filterInterruptHook() = std::move(m_hook);
+	}
+
+private:
+	FilterInterruptHook m_hook;
+};
+
 struct List
 {
 	struct Properties
@@ -116,6 +152,13 @@ struct List
 	virtual ConstIterator beginP() const = 0;
 	virtual Iterator endP() = 0;
 	virtual ConstIterator endP() const = 0;
+
+	// Operations on properties of items that don't go through type erased
+	// iterators, for use when many items are processed at once.
+	virtual Properties &currentProperties() = 0;
+	virtual bool selectedRange(size_t &first, size_t &last) const = 0;
+	virtual void setSelected(size_t first, size_t last, bool is_selected) = 0;
+	virtual void reverseSelection() = 0;
 };
 
 inline List::Properties::Type operator|(List::Properties::Type lhs, List::Properties::Type rhs)
@@ -154,22 +197,14 @@ struct Menu: Window, List
 		typedef ItemT Type;
 
 		Item()
-			: m_impl(std::make_shared<std::tuple<ItemT, Properties>>())
-		{ }
-
-		template <typename ValueT, typename PropertiesT>
-		Item(ValueT &&value_, PropertiesT properties_)
-			: m_impl(
-				std::make_shared<std::tuple<ItemT, List::Properties>>(
-					std::forward<ValueT>(value_),
-					std::forward<PropertiesT>(properties_)))
+			: m_value(nullptr), m_properties(nullptr)
 		{ }
 
-		ItemT &value() { return std::get<0>(*m_impl); }
-		const ItemT &value() const { return std::get<0>(*m_impl); }
+		ItemT &value() { return *m_value; }
+		const ItemT &value() const { return *m_value; }
 
-		Properties &properties() { return std::get<1>(*m_impl); }
-		const Properties &properties() const { return std::get<1>(*m_impl); }
+		Properties &properties() { return *m_properties; }
+		const Properties &properties() const { return *m_properties; }
 
 		// Forward methods to List::Properties.
 		void setSelectable(bool is_selectable) { properties().setSelectable(is_selectable); }
@@ -182,12 +217,11 @@ struct Menu: Window, List
 		bool isInactive() const { return properties().isInactive(); }
 		bool isSeparator() const { return properties().isSeparator(); }
 
-		// Make a deep copy of Item.
-		Item copy() const {
-			return Item(value(), properties());
-		}
-
 	private:
+		Item(ItemT *value_, Properties *properties_)
+			: m_value(value_), m_properties(properties_)
+		{ }
+
 		template <Const const_>
 		struct ExtractProperties
 		{
@@ -226,15 +260,8 @@ struct Menu: Window, List
 			}
 		};
 
-		static Item mkSeparator()
-		{
-			Item item;
-			item.setSelectable(false);
-			item.setSeparator(true);
-			return item;
-		}
-		
-		std::shared_ptr<std::tuple<ItemT, Properties>> m_impl;
+		ItemT *m_value;
+		Properties *m_properties;
 	};
 
 	typedef typename std::vector<Item>::iterator Iterator;
@@ -336,10 +363,24 @@ struct Menu: Window, List
 	void reset();
 
 	/// Apply filter predicate to items in the menu and show the ones for which it
-	/// returned true.
+	/// returned true. Large menus are filtered in parallel, so the predicate needs
+	/// to be thread safe. If filtering is interrupted, FilterInterrupted is thrown
+	/// and the menu is left unchanged.
 	template <typename PredicateT>
 	void applyFilter(PredicateT &&pred);
 
+	/// Apply filter predicate to the items that are currently shown. It can be
+	/// used instead of applyFilter() if the predicate accepts only a subset of
+	/// items accepted by the current one. Current results are remembered, so
+	/// that they can be restored with revertFilter().
+	template <typename PredicateT>
+	void refineFilter(PredicateT &&pred);
+
+	/// Restore the filter that was in place before the last call to
+	/// refineFilter() along with its results.
+	/// @return false if there is no such filter
+	bool revertFilter();
+
 	/// Reapply previously applied filter.
 	void reapplyFilter();
 
@@ -482,6 +523,20 @@ struct Menu: Window, List
 		return List::ConstIterator(ConstPropertiesIterator(m_items->end()));
 	}
 
+	virtual Properties &currentProperties() override {
+		return (*m_items)[m_highlight].properties();
+	}
+
+	/// Find the smallest range of positions containing all selected items.
+	/// @return false if there are no selected items
+	virtual bool selectedRange(size_t &first, size_t &last) const override;
+
+	/// Set selection of items in the given range of positions.
+	virtual void setSelected(size_t first, size_t last, bool is_selected) override;
+
+	/// Invert selection of all items.
+	virtual void reverseSelection() override;
+
 private:
 	bool isHighlightable(size_t pos)
 	{
@@ -489,12 +544,68 @@ private:
 			&& !(*m_items)[pos].isInactive();
 	}
 
+	/// Storage for values and properties of items. They're kept in blocks of
+	/// contiguous arrays, so that items don't need separate allocations and
+	/// don't move when more of them are added.
+	struct Storage
+	{
+		Storage() : m_size(0) { }
+		Storage(const Storage &) = delete;
+		Storage(Storage &&rhs) : Storage() { swap(rhs); }
+		Storage &operator=(Storage rhs) { swap(rhs); return *this; }
+		~Storage() { clear(); }
+
+		void swap(Storage &rhs)
+		{
+			std::swap(m_blocks, rhs.m_blocks);
+			std::swap(m_size, rhs.m_size);
+		}
+
+		size_t size() const { return m_size; }
+
+		template <typename ValueT>
+		Item add(ValueT &&value, Properties properties);
+
+		/// Destroy all values, but keep the memory for reuse.
+		void clear();
+
+	private:
+		static const size_t BlockSize = 256;
+
+		struct Block
+		{
+			typename std::aligned_storage<sizeof(ItemT), alignof(ItemT)>::type values[BlockSize];
+			Properties properties[BlockSize];
+		};
+
+		std::vector<std::unique_ptr<Block>> m_blocks;
+		size_t m_size;
+	};
+
+	Item newItem(ItemT value, Properties::Type properties)
+	{
+		return m_storage.add(std::move(value), properties);
+	}
+
+	/// Move items that are still in the list to new storage, reclaiming space
+	/// of the ones that were removed from it.
+	void compactStorage();
+
 	ItemDisplayer m_item_displayer;
 	FilterPredicate m_filter_predicate;
 
+	/// Check items against the predicate using the shared thread pool.
+	static std::vector<Item> filterItems(const std::vector<Item> &items,
+	                                     const FilterPredicate &predicate);
+
+	/// Maximum number of filters remembered by refineFilter()
+	static const size_t FilterHistorySize = 16;
+
+	Storage m_storage;
 	std::vector<Item> *m_items;
 	std::vector<Item> m_all_items;
 	std::vector<Item> m_filtered_items;
+	std::vector<std::pair<FilterPredicate, std::vector<Item>>> m_filter_history;
 	
 	size_t m_beginning;
 	size_t m_highlight;
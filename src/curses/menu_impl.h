@@ -21,6 +21,9 @@
 #ifndef NCMPCPP_MENU_IMPL_H
 #define NCMPCPP_MENU_IMPL_H
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "menu.h"
 
 namespace NC {
@@ -73,7 +76,7 @@ Menu<ItemT>::Menu(const Menu &rhs)
 	// TODO: move filtered items
 	m_all_items.reserve(rhs.m_all_items.size());
 	for (const auto &item : rhs.m_all_items)
-		m_all_items.push_back(item.copy());
+		m_all_items.push_back(m_storage.add(item.value(), item.properties()));
 	m_items = &m_all_items;
 }
 
@@ -82,8 +85,10 @@ Menu<ItemT>::Menu(Menu &&rhs)
 	: Window(rhs)
 	, m_item_displayer(std::move(rhs.m_item_displayer))
 	, m_filter_predicate(std::move(rhs.m_filter_predicate))
+	, m_storage(std::move(rhs.m_storage))
 	, m_all_items(std::move(rhs.m_all_items))
 	, m_filtered_items(std::move(rhs.m_filtered_items))
+	, m_filter_history(std::move(rhs.m_filter_history))
 	, m_beginning(rhs.m_beginning)
 	, m_highlight(rhs.m_highlight)
 	, m_highlight_enabled(rhs.m_highlight_enabled)
@@ -107,8 +112,10 @@ Menu<ItemT> &Menu<ItemT>::operator=(Menu rhs)
 	std::swap(static_cast<Window &>(*this), static_cast<Window &>(rhs));
 	std::swap(m_item_displayer, rhs.m_item_displayer);
 	std::swap(m_filter_predicate, rhs.m_filter_predicate);
+	m_storage.swap(rhs.m_storage);
 	std::swap(m_all_items, rhs.m_all_items);
 	std::swap(m_filtered_items, rhs.m_filtered_items);
+	std::swap(m_filter_history, rhs.m_filter_history);
 	std::swap(m_beginning, rhs.m_beginning);
 	std::swap(m_highlight, rhs.m_highlight);
 	std::swap(m_highlight_enabled, rhs.m_highlight_enabled);
@@ -132,34 +139,95 @@ void Menu<ItemT>::setItemDisplayer(ItemDisplayerT &&displayer)
 	m_item_displayer = std::forward<ItemDisplayerT>(displayer);
 }
 
+template <typename ItemT> template <typename ValueT>
+typename Menu<ItemT>::Item Menu<ItemT>::Storage::add(ValueT &&value, Properties properties)
+{
+	size_t block = m_size / BlockSize, offset = m_size % BlockSize;
+	if (block == m_blocks.size())
+		m_blocks.push_back(std::make_unique<Block>());
+	auto &b = *m_blocks[block];
+	ItemT *value_ = new (&b.values[offset]) ItemT(std::forward<ValueT>(value));
+	b.properties[offset] = properties;
+	++m_size;
+	return Item(value_, &b.properties[offset]);
+}
+
+template <typename ItemT>
+void Menu<ItemT>::Storage::clear()
+{
+	for (size_t i = 0; i < m_size; ++i)
+	{
+		auto &b = *m_blocks[i / BlockSize];
+		reinterpret_cast<ItemT *>(&b.values[i % BlockSize])->~ItemT();
+	}
+	m_size = 0;
+}
+
+template <typename ItemT>
+void Menu<ItemT>::compactStorage()
+{
+	Storage storage;
+	std::unordered_map<const ItemT *, Item> moved;
+	for (auto &item : m_all_items)
+	{
+		Item new_item = storage.add(std::move(item.value()), item.properties());
+		if (!m_filtered_items.empty())
+			moved.emplace(item.m_value, new_item);
+		item = new_item;
+	}
+	// Filtered items that are no longer in the list are dropped.
+	std::vector<Item> filtered_items;
+	for (const auto &item : m_filtered_items)
+	{
+		auto it = moved.find(item.m_value);
+		if (it != moved.end())
+			filtered_items.push_back(it->second);
+	}
+	m_filtered_items = std::move(filtered_items);
+	m_filter_history.clear();
+	m_storage = std::move(storage);
+}
+
 template <typename ItemT>
 void Menu<ItemT>::resizeList(size_t new_size)
 {
-	m_all_items.resize(new_size);
+	if (new_size < m_all_items.size())
+		m_all_items.erase(m_all_items.begin()+new_size, m_all_items.end());
+	else
+	{
+		m_all_items.reserve(new_size);
+		while (m_all_items.size() < new_size)
+			m_all_items.push_back(newItem(ItemT(), Properties::Selectable));
+	}
+	m_filter_history.clear();
+	// Removed items stay in the storage as filtered items might still refer to
+	// them. Reclaim the space once they make up most of it.
+	if (m_storage.size() > 2*m_all_items.size() + 1024)
+		compactStorage();
 }
 
 template <typename ItemT>
 void Menu<ItemT>::addItem(ItemT item, Properties::Type properties)
 {
-	m_all_items.push_back(Item(std::move(item), properties));
+	m_all_items.push_back(newItem(std::move(item), properties));
 }
 
 template <typename ItemT>
 void Menu<ItemT>::addSeparator()
 {
-	m_all_items.push_back(Item::mkSeparator());
+	m_all_items.push_back(newItem(ItemT(), Properties::Separator));
 }
 
 template <typename ItemT>
 void Menu<ItemT>::insertItem(size_t pos, ItemT item, Properties::Type properties)
 {
-	m_all_items.insert(m_all_items.begin()+pos, Item(std::move(item), properties));
+	m_all_items.insert(m_all_items.begin()+pos, newItem(std::move(item), properties));
 }
 
 template <typename ItemT>
 void Menu<ItemT>::insertSeparator(size_t pos)
 {
-	m_all_items.insert(m_all_items.begin()+pos, Item::mkSeparator());
+	m_all_items.insert(m_all_items.begin()+pos, newItem(ItemT(), Properties::Separator));
 }
 
 template <typename ItemT>
@@ -334,6 +402,8 @@ void Menu<ItemT>::clear()
 	// Don't clear filter related stuff here.
 	m_all_items.clear();
 	m_filtered_items.clear();
+	m_filter_history.clear();
+	m_storage.clear();
 }
 
 template <typename ItemT>
@@ -355,19 +425,110 @@ size_t Menu<ItemT>::choice() const
 	return m_highlight;
 }
 
+template <typename ItemT>
+bool Menu<ItemT>::selectedRange(size_t &first, size_t &last) const
+{
+	auto is_selected = [](const Item &item) { return item.isSelected(); };
+	auto begin = std::find_if(m_items->begin(), m_items->end(), is_selected);
+	if (begin == m_items->end())
+		return false;
+	auto end = std::find_if(m_items->rbegin(), m_items->rend(), is_selected).base();
+	first = begin - m_items->begin();
+	last = end - m_items->begin();
+	return true;
+}
+
+template <typename ItemT>
+void Menu<ItemT>::setSelected(size_t first, size_t last, bool is_selected)
+{
+	assert(first <= last && last <= m_items->size());
+	for (; first != last; ++first)
+		(*m_items)[first].setSelected(is_selected);
+}
+
+template <typename ItemT>
+void Menu<ItemT>::reverseSelection()
+{
+	for (auto &item : *m_items)
+		item.setSelected(!item.isSelected());
+}
+
 template <typename ItemT> template <typename PredicateT>
 void Menu<ItemT>::applyFilter(PredicateT &&pred)
 {
-	m_filter_predicate = std::forward<PredicateT>(pred);
-	m_filtered_items.clear();
+	FilterPredicate predicate = std::forward<PredicateT>(pred);
+	auto items = filterItems(m_all_items, predicate);
 
-	for (const auto &item : m_all_items)
-		if (m_filter_predicate(item))
-			m_filtered_items.push_back(item);
+	m_filter_predicate = std::move(predicate);
+	m_filtered_items = std::move(items);
+	m_filter_history.clear();
 
 	m_items = &m_filtered_items;
 }
 
+template <typename ItemT> template <typename PredicateT>
+void Menu<ItemT>::refineFilter(PredicateT &&pred)
+{
+	if (!m_filter_predicate)
+	{
+		applyFilter(std::forward<PredicateT>(pred));
+		return;
+	}
+
+	FilterPredicate predicate = std::forward<PredicateT>(pred);
+	auto items = filterItems(m_filtered_items, predicate);
+
+	if (m_filter_history.size() == FilterHistorySize)
+		m_filter_history.erase(m_filter_history.begin());
+	m_filter_history.emplace_back(
+		std::move(m_filter_predicate), std::move(m_filtered_items));
+	m_filter_predicate = std::move(predicate);
+	m_filtered_items = std::move(items);
+
+	m_items = &m_filtered_items;
+}
+
+template <typename ItemT>
+bool Menu<ItemT>::revertFilter()
+{
+	if (m_filter_history.empty())
+		return false;
+	m_filter_predicate = std::move(m_filter_history.back().first);
+	m_filtered_items = std::move(m_filter_history.back().second);
+	m_filter_history.pop_back();
+	m_items = &m_filtered_items;
+	return true;
+}
+
+template <typename ItemT>
+std::vector<typename Menu<ItemT>::Item> Menu<ItemT>::filterItems(
+	const std::vector<Item> &items, const FilterPredicate &predicate)
+{
+	// Number of items checked by a single thread at once. Menus smaller than
+	// that are filtered on the calling thread only.
+	const size_t chunk_size = 1024;
+
+	const auto &interrupted = filterInterruptHook();
+	std::vector<char> matches(items.size());
+	bool finished = ThreadPool::instance().forEachChunk(
+		items.size(), chunk_size,
+		[&items, &predicate, &matches](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				matches[i] = predicate(items[i]);
+		},
+		[&interrupted] {
+			return interrupted && interrupted();
+		});
+	if (!finished)
+		throw FilterInterrupted();
+
+	std::vector<Item> result;
+	for (size_t i = 0; i < items.size(); ++i)
+		if (matches[i])
+			result.push_back(items[i]);
+	return result;
+}
+
 template <typename ItemT>
 void Menu<ItemT>::reapplyFilter()
 {
@@ -385,6 +546,7 @@ void Menu<ItemT>::clearFilter()
 {
 	m_filter_predicate = nullptr;
 	m_filtered_items.clear();
+	m_filter_history.clear();
 	m_items = &m_all_items;
 }
 
@@ -70,7 +70,7 @@ void Scrollpad::refresh()
 	assert(m_real_height >= m_height);
 	size_t max_beginning = m_real_height - m_height;
 	m_beginning = std::min(m_beginning, max_beginning);
-	prefresh(m_window, m_beginning, 0, m_start_y, m_start_x, m_start_y+m_height-1, m_start_x+m_width-1);
+	copyToScreen(m_beginning);
 }
 
 void Scrollpad::resize(size_t new_width, size_t new_height)
@@ -37,6 +37,9 @@ namespace {
 // run as high as 2^24. We only work with up to 256.
 int maxColor;
 
+// Whether virtual screen contains changes not sent to the terminal yet.
+bool screen_update_pending = false;
+
 namespace rl {
 
 bool aborted;
@@ -483,6 +486,15 @@ void destroyScreen()
 	endwin();
 }
 
+void updateScreen()
+{
+	if (screen_update_pending)
+	{
+		doupdate();
+		screen_update_pending = false;
+	}
+}
+
 Window::Window(size_t startx, size_t starty, size_t width, size_t height,
                std::string title, Color color, Border border)
 	: m_window(nullptr),
@@ -748,7 +760,8 @@ void Window::refreshBorder() const
 		mvhline(m_start_y-1, m_start_x, 0, m_width);
 	}
 	standend();
-	::refresh();
+	wnoutrefresh(stdscr);
+	screen_update_pending = true;
 }
 
 void Window::display()
@@ -759,7 +772,16 @@ void Window::display()
 
 void Window::refresh()
 {
-	prefresh(m_window, 0, 0, m_start_y, m_start_x, m_start_y+m_height-1, m_start_x+m_width-1);
+	copyToScreen(0);
+}
+
+void Window::copyToScreen(size_t pad_y)
+{
+	// Only lines of the pad that changed since it was last copied are
+	// transferred, doupdate() then sends out only the ones that differ from
+	// what's already on the terminal.
+	pnoutrefresh(m_window, pad_y, 0, m_start_y, m_start_x, m_start_y+m_height-1, m_start_x+m_width-1);
+	screen_update_pending = true;
 }
 
 void Window::clear()
@@ -1152,6 +1174,9 @@ Key::Type Window::readKey()
 		m_input_queue.pop();
 		return result;
 	}
+
+	// Make sure that everything drawn so far is visible before waiting.
+	updateScreen();
 	
 	fd_set fds_read;
 	FD_ZERO(&fds_read);
@@ -1190,6 +1215,17 @@ Key::Type Window::readKey()
 	return result;
 }
 
+bool Window::inputPending() const
+{
+	if (!m_input_queue.empty())
+		return true;
+	fd_set fds_read;
+	FD_ZERO(&fds_read);
+	FD_SET(STDIN_FILENO, &fds_read);
+	timeval timeout = { 0, 0 };
+	return select(STDIN_FILENO+1, &fds_read, nullptr, nullptr, &timeout) > 0;
+}
+
 void Window::pushChar(const Key::Type ch)
 {
 	m_input_queue.push(ch);
@@ -233,6 +233,11 @@ void unpauseScreen();
 /// Destroys the screen
 void destroyScreen();
 
+/// Sends changes of windows refreshed since the last call to the terminal.
+/// Window::refresh() only copies them to the virtual screen, so that all
+/// windows redrawn in a row are sent out at once.
+void updateScreen();
+
 /// Struct used for going to given coordinates
 /// @see Window::operator<<()
 struct XY
@@ -442,6 +447,9 @@ struct Window
 	/// and writes it into read_key variable
 	Key::Type readKey();
 	
+	/// @return true if readKey() would return immediately with input
+	bool inputPending() const;
+	
 	/// Push single character into input queue, so it can get consumed by ReadKey
 	void pushChar(const NC::Key::Type ch);
 	
@@ -489,6 +497,12 @@ protected:
 	///
 	virtual void recreate(size_t width, size_t height);
 	
+	/// Copies the window, starting from given line of the underlying pad, to
+	/// the virtual screen, to be sent to the terminal by updateScreen().
+	/// @see updateScreen()
+	///
+	void copyToScreen(size_t pad_y);
+	
 	/// internal WINDOW pointers
 	WINDOW *m_window;
 	
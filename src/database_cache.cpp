@@ -0,0 +1,598 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "database_cache.h"
+#include "mpdpp.h"
+#include "settings.h"
+#include "utility/binary_io.h"
+
+namespace DatabaseCache {
+
+struct SongIterator::State
+{
+	virtual ~State() { }
+
+	// Fetch the next song, return false if there are no more songs.
+	virtual bool fetch() = 0;
+
+	virtual bool isLocal() const = 0;
+
+	MPD::Song song;
+};
+
+}
+
+namespace {
+
+// Cache layout (all integers are stored as LEB128 varints, strings are
+// prefixed with their length):
+//
+// header: magic, version, server address, database update time
+// song:   uri, mtime, duration, number of tags, (tag type, value)*
+// end:    empty uri, number of songs as 8 byte little endian integer
+//
+// The end marker makes it possible to tell a complete cache from a truncated
+// one before reading it, as songs never have an empty uri.
+const char cache_magic[] = "ncmpcpp-db";
+const uint64_t cache_version = 2;
+
+const mpd_tag_type cached_tags[] = {
+	MPD_TAG_ARTIST,
+	MPD_TAG_ALBUM,
+	MPD_TAG_ALBUM_ARTIST,
+	MPD_TAG_TITLE,
+	MPD_TAG_TRACK,
+	MPD_TAG_NAME,
+	MPD_TAG_GENRE,
+	MPD_TAG_DATE,
+	MPD_TAG_COMPOSER,
+	MPD_TAG_PERFORMER,
+	MPD_TAG_COMMENT,
+	MPD_TAG_DISC,
+};
+
+// Whether the cache on disk is known to match the current database.
+bool cache_up_to_date = false;
+
+// Whether the cache is being rebuilt by the worker connection.
+bool cache_refreshing = false;
+
+// Incremented each time the cache is invalidated, so that the result of
+// a refresh started before that is not considered up to date.
+unsigned cache_generation = 0;
+
+// If rebuilding the cache in the background failed, it's not retried until
+// the database changes, songs are fetched through the main connection then.
+bool cache_refresh_failed = false;
+unsigned long failed_db_update_time = 0;
+
+// Paths of songs in the cache not matching random_exclude_pattern, kept in
+// memory so that random songs can be picked without going through the whole
+// database each time.
+struct PathIndex
+{
+	PathIndex()
+	: valid(false)
+	{ }
+
+	size_t size() const
+	{
+		return offsets.size();
+	}
+
+	std::string get(size_t i) const
+	{
+		size_t end = i+1 < offsets.size() ? offsets[i+1] : paths.size();
+		return paths.substr(offsets[i], end-offsets[i]);
+	}
+
+	bool valid;
+	std::string paths;
+	std::vector<size_t> offsets;
+};
+
+PathIndex path_index;
+
+std::string cachePath()
+{
+	return Config.ncmpcpp_directory + "database_cache";
+}
+
+std::string serverAddress()
+{
+	return Mpd.GetHostname() + ":" + std::to_string(Mpd.GetPort());
+}
+
+void writeHeader(std::ostream &os, const std::string &address, unsigned long db_update_time)
+{
+	writeString(os, cache_magic);
+	writeNumber(os, cache_version);
+	writeString(os, address);
+	writeNumber(os, db_update_time);
+}
+
+bool readHeader(std::istream &is, unsigned long &db_update_time)
+{
+	std::string magic, address;
+	uint64_t version, update_time;
+	if (readString(is, magic) && magic == cache_magic
+	    && readNumber(is, version) && version == cache_version
+	    && readString(is, address) && address == serverAddress()
+	    && readNumber(is, update_time))
+	{
+		db_update_time = update_time;
+		return true;
+	}
+	else
+		return false;
+}
+
+void writeSong(std::ostream &os, const MPD::Song &s)
+{
+	std::vector<std::pair<mpd_tag_type, std::string>> tags;
+	for (const auto &type : cached_tags)
+	{
+		std::string tag;
+		for (unsigned idx = 0; !(tag = s.get(type, idx)).empty(); ++idx)
+			tags.emplace_back(type, std::move(tag));
+	}
+	writeString(os, s.c_uri());
+	writeNumber(os, s.getMTime());
+	writeNumber(os, s.getDuration());
+	writeNumber(os, tags.size());
+	for (const auto &tag : tags)
+	{
+		writeNumber(os, tag.first);
+		writeString(os, tag.second);
+	}
+}
+
+MPD::Song readSong(std::istream &is)
+{
+	std::string uri, value;
+	uint64_t mtime, duration, tags;
+	if (!readString(is, uri)
+	    || !readNumber(is, mtime)
+	    || !readNumber(is, duration)
+	    || !readNumber(is, tags))
+		return MPD::Song();
+
+	mpd_pair pair = { "file", uri.c_str() };
+	std::unique_ptr<mpd_song, void (*)(mpd_song *)> s(
+		mpd_song_begin(&pair), mpd_song_free);
+	if (s == nullptr)
+		return MPD::Song();
+
+	// Last modification time is parsed by libmpdclient from ISO 8601 format.
+	char buf[32];
+	time_t t = mtime;
+	tm tinfo;
+	gmtime_r(&t, &tinfo);
+	strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tinfo);
+	pair = { "Last-Modified", buf };
+	mpd_song_feed(s.get(), &pair);
+	value = std::to_string(duration);
+	pair = { "Time", value.c_str() };
+	mpd_song_feed(s.get(), &pair);
+
+	for (; tags > 0; --tags)
+	{
+		uint64_t type;
+		if (!readNumber(is, type)
+		    || type >= MPD_TAG_COUNT
+		    || !readString(is, value))
+			return MPD::Song();
+		pair = { mpd_tag_name(mpd_tag_type(type)), value.c_str() };
+		if (pair.name != nullptr)
+			mpd_song_feed(s.get(), &pair);
+	}
+	return MPD::Song(s.release());
+}
+
+const size_t end_size = 9;
+
+void writeEnd(std::ostream &os, uint64_t songs)
+{
+	os.put(0);
+	for (size_t i = 0; i < end_size-1; ++i)
+		os.put(static_cast<char>(songs >> 8*i));
+}
+
+bool readEnd(std::istream &is, uint64_t &songs)
+{
+	char buf[end_size];
+	if (!is.read(buf, end_size) || buf[0] != 0)
+		return false;
+	songs = 0;
+	for (size_t i = 0; i < end_size-1; ++i)
+		songs |= uint64_t(static_cast<unsigned char>(buf[i+1])) << 8*i;
+	return true;
+}
+
+bool endFollows(std::istream &is)
+{
+	return is.peek() == 0;
+}
+
+// Check whether the end marker is in place without moving the stream.
+bool hasEnd(std::istream &is)
+{
+	auto pos = is.tellg();
+	uint64_t songs;
+	bool result = is.seekg(-std::streamoff(end_size), std::ios::end) && readEnd(is, songs);
+	is.clear();
+	is.seekg(pos);
+	return result && bool(is);
+}
+
+// Remove the cache if it turned out to be corrupted.
+void discardCache()
+{
+	std::remove(cachePath().c_str());
+	cache_up_to_date = false;
+	path_index.valid = false;
+}
+
+// Read the path of the song, skipping the rest of its data.
+bool readSongPath(std::istream &is, std::string &uri)
+{
+	uint64_t n, tags;
+	if (!readString(is, uri)
+	    || !readNumber(is, n)
+	    || !readNumber(is, n)
+	    || !readNumber(is, tags))
+		return false;
+	for (; tags > 0; --tags)
+		if (!readNumber(is, n) || !skipString(is))
+			return false;
+	return true;
+}
+
+bool loadPathIndex(std::ifstream &file)
+{
+	const auto &exclude = Config.random_exclude_pattern;
+	path_index.paths.clear();
+	path_index.offsets.clear();
+	std::string uri;
+	uint64_t songs = 0, cached_songs;
+	for (; !endFollows(file) && readSongPath(file, uri); ++songs)
+	{
+		if (exclude.empty() || !boost::regex_match(uri, exclude))
+		{
+			path_index.offsets.push_back(path_index.paths.size());
+			path_index.paths += uri;
+		}
+	}
+	if (!readEnd(file, cached_songs) || cached_songs != songs)
+	{
+		path_index.paths.clear();
+		path_index.offsets.clear();
+		file.close();
+		discardCache();
+		return false;
+	}
+	path_index.paths.shrink_to_fit();
+	path_index.offsets.shrink_to_fit();
+	path_index.valid = true;
+	return true;
+}
+
+struct CacheReader: DatabaseCache::SongIterator::State
+{
+	CacheReader(std::ifstream &&file)
+	: m_file(std::move(file))
+	, m_songs(0)
+	{ }
+
+	virtual bool fetch() override
+	{
+		if (endFollows(m_file))
+		{
+			uint64_t songs;
+			if (!readEnd(m_file, songs) || songs != m_songs)
+			{
+				m_file.close();
+				discardCache();
+			}
+			return false;
+		}
+		song = readSong(m_file);
+		if (song.empty())
+		{
+			// The cache is truncated or corrupted.
+			m_file.close();
+			discardCache();
+			return false;
+		}
+		++m_songs;
+		return true;
+	}
+
+	virtual bool isLocal() const override
+	{
+		return true;
+	}
+
+private:
+	std::ifstream m_file;
+	uint64_t m_songs;
+};
+
+// Writes the cache to a temporary file and replaces the old one with it once
+// all songs are written. As it doesn't touch any global state, it can be used
+// from the worker thread.
+struct CacheWriter
+{
+	CacheWriter(std::string path, const std::string &address, unsigned long db_update_time)
+	: m_path(std::move(path))
+	, m_tmp_path(m_path + ".tmp")
+	, m_songs(0)
+	{
+		m_file.open(m_tmp_path, std::ios::binary | std::ios::trunc);
+		if (m_file)
+			writeHeader(m_file, address, db_update_time);
+	}
+
+	~CacheWriter()
+	{
+		// Incomplete cache is useless, get rid of it.
+		if (m_file.is_open())
+		{
+			m_file.close();
+			std::remove(m_tmp_path.c_str());
+		}
+	}
+
+	void write(const MPD::Song &s)
+	{
+		if (m_file.is_open())
+		{
+			writeSong(m_file, s);
+			++m_songs;
+		}
+	}
+
+	// Returns true if the cache was successfully written.
+	bool commit()
+	{
+		if (!m_file.is_open())
+			return false;
+		writeEnd(m_file, m_songs);
+		m_file.close();
+		if (m_file && std::rename(m_tmp_path.c_str(), m_path.c_str()) == 0)
+			return true;
+		std::remove(m_tmp_path.c_str());
+		return false;
+	}
+
+private:
+	std::string m_path;
+	std::string m_tmp_path;
+	std::ofstream m_file;
+	uint64_t m_songs;
+};
+
+struct DatabaseFetcher: DatabaseCache::SongIterator::State
+{
+	DatabaseFetcher()
+	: m_songs(Mpd.GetDirectoryRecursive("/"))
+	{ }
+
+	DatabaseFetcher(std::string path, unsigned long db_update_time)
+	: m_songs(Mpd.GetDirectoryRecursive("/"))
+	, m_writer(std::make_unique<CacheWriter>(
+		std::move(path), serverAddress(), db_update_time))
+	{ }
+
+	virtual bool fetch() override
+	{
+		if (m_songs == MPD::SongIterator())
+		{
+			if (m_writer != nullptr)
+				cache_up_to_date = m_writer->commit();
+			return false;
+		}
+		song = std::move(*m_songs);
+		if (m_writer != nullptr)
+			m_writer->write(song);
+		++m_songs;
+		return true;
+	}
+
+	virtual bool isLocal() const override
+	{
+		return false;
+	}
+
+private:
+	MPD::SongIterator m_songs;
+	std::unique_ptr<CacheWriter> m_writer;
+};
+
+// Check whether the cache matches the database. If it does, file is left
+// positioned at the first song. Otherwise db_update_time is set to the
+// current database update time.
+bool checkCache(std::ifstream &file, unsigned long &db_update_time)
+{
+	unsigned long cached_db_update_time;
+	bool have_header = file && readHeader(file, cached_db_update_time) && hasEnd(file);
+	if (!have_header || !cache_up_to_date)
+	{
+		db_update_time = Mpd.getStatistics().dbUpdateTime();
+		cache_up_to_date = have_header && cached_db_update_time == db_update_time;
+	}
+	return cache_up_to_date;
+}
+
+}
+
+namespace DatabaseCache {
+
+SongIterator::SongIterator(std::shared_ptr<State> state)
+: m_state(std::move(state))
+{
+	// get the first element
+	++*this;
+}
+
+MPD::Song &SongIterator::operator*() const
+{
+	if (!m_state)
+		throw std::runtime_error("no song associated with the iterator");
+	return m_state->song;
+}
+
+bool SongIterator::isLocal() const
+{
+	return m_state != nullptr && m_state->isLocal();
+}
+
+SongIterator &SongIterator::operator++()
+{
+	assert(m_state);
+	if (!m_state->fetch())
+		m_state = nullptr;
+	return *this;
+}
+
+SongIterator songs()
+{
+	// If the cache is being rebuilt in the background, don't interfere.
+	if (!Config.database_cache || cache_refreshing)
+		return SongIterator(std::make_shared<DatabaseFetcher>());
+
+	std::string path = cachePath();
+	std::ifstream file(path, std::ios::binary);
+	unsigned long db_update_time = 0;
+	if (checkCache(file, db_update_time))
+		return SongIterator(std::make_shared<CacheReader>(std::move(file)));
+	else
+		return SongIterator(std::make_shared<DatabaseFetcher>(
+			std::move(path), db_update_time));
+}
+
+bool refreshInBackground()
+{
+	if (!Config.database_cache)
+		return false;
+	if (cache_refreshing)
+		return true;
+
+	std::string path = cachePath();
+	std::ifstream file(path, std::ios::binary);
+	unsigned long db_update_time = 0;
+	if (checkCache(file, db_update_time))
+		return false;
+	if (cache_refresh_failed && failed_db_update_time == db_update_time)
+		return false;
+
+	cache_refreshing = true;
+	unsigned generation = cache_generation;
+	auto failed = [db_update_time] {
+		cache_refreshing = false;
+		cache_refresh_failed = true;
+		failed_db_update_time = db_update_time;
+	};
+	MpdWorker.submit(
+		[path, address = serverAddress(), db_update_time](MPD::Connection &c) {
+			CacheWriter writer(path, address, db_update_time);
+			for (MPD::SongIterator s = c.GetDirectoryRecursive("/"), end; s != end; ++s)
+				writer.write(*s);
+			return writer.commit();
+		},
+		[generation, failed](bool success) {
+			if (!success)
+			{
+				failed();
+				return;
+			}
+			cache_refreshing = false;
+			cache_refresh_failed = false;
+			cache_up_to_date = generation == cache_generation;
+		},
+		// Errors are reported by processResults.
+		failed);
+	return true;
+}
+
+std::vector<std::string> randomPaths(size_t number, std::mt19937 &rng)
+{
+	if (Config.database_cache && !cache_refreshing && !path_index.valid)
+	{
+		std::ifstream file(cachePath(), std::ios::binary);
+		unsigned long db_update_time;
+		if (checkCache(file, db_update_time))
+			loadPathIndex(file);
+	}
+
+	if (path_index.valid)
+	{
+		// Partial Fisher-Yates shuffle of the index, with swapped positions
+		// stored on the side so that the index itself is left untouched.
+		std::vector<std::string> paths;
+		std::unordered_map<size_t, size_t> swapped;
+		auto at = [&swapped](size_t i) {
+			auto it = swapped.find(i);
+			return it != swapped.end() ? it->second : i;
+		};
+		number = std::min(number, path_index.size());
+		paths.reserve(number);
+		for (size_t i = 0; i < number; ++i)
+		{
+			size_t j = std::uniform_int_distribution<size_t>(i, path_index.size()-1)(rng);
+			size_t chosen = at(j);
+			swapped[j] = at(i);
+			paths.push_back(path_index.get(chosen));
+		}
+		return paths;
+	}
+	else
+	{
+		const auto &exclude = Config.random_exclude_pattern;
+		return Mpd.GetRandomSongPaths(number, [&exclude](const char *path) {
+				return exclude.empty() || !boost::regex_match(path, exclude);
+			}, rng);
+	}
+}
+
+bool refreshing()
+{
+	return cache_refreshing;
+}
+
+void invalidate()
+{
+	cache_up_to_date = false;
+	path_index.valid = false;
+	++cache_generation;
+}
+
+}
@@ -0,0 +1,99 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#ifndef NCMPCPP_DATABASE_CACHE_H
+#define NCMPCPP_DATABASE_CACHE_H
+
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "song.h"
+
+namespace DatabaseCache {
+
+// Input iterator over all songs in the MPD database. Depending on the state
+// of the cache it either reads them from the local copy or streams them from
+// MPD, writing a fresh copy of the cache along the way.
+struct SongIterator: std::iterator<std::input_iterator_tag, MPD::Song>
+{
+	struct State;
+
+	SongIterator() { }
+	SongIterator(std::shared_ptr<State> state);
+
+	MPD::Song &operator*() const;
+	MPD::Song *operator->() const
+	{
+		return &**this;
+	}
+
+	// Whether songs are read from the local cache, i.e. the iterator doesn't
+	// occupy the MPD connection and can be kept around between MPD commands.
+	bool isLocal() const;
+
+	SongIterator &operator++();
+	SongIterator operator++(int)
+	{
+		SongIterator it(*this);
+		++*this;
+		return it;
+	}
+
+	bool operator==(const SongIterator &rhs) const
+	{
+		return m_state == rhs.m_state;
+	}
+	bool operator!=(const SongIterator &rhs) const
+	{
+		return !(*this == rhs);
+	}
+
+private:
+	std::shared_ptr<State> m_state;
+};
+
+// Replacement for Mpd.GetDirectoryRecursive("/"). If the cache is disabled,
+// songs are taken directly from MPD.
+SongIterator songs();
+
+// If the cache is outdated, start rebuilding it in the background using the
+// worker connection. Returns true if the cache is being rebuilt. If rebuilding
+// failed, it's not started again until the database changes and songs() has
+// to be used instead.
+bool refreshInBackground();
+
+// Pick at most the given number of random paths of songs in the database that
+// don't match random_exclude_pattern. If the cache is up to date, paths are
+// loaded from it once and kept in memory, otherwise they're streamed from MPD.
+std::vector<std::string> randomPaths(size_t number, std::mt19937 &rng);
+
+// Whether the cache is being rebuilt in the background.
+bool refreshing();
+
+// Mark the cache as outdated, so that the next call to songs() checks the
+// database update time and refetches the database if it changed.
+void invalidate();
+
+}
+
+#endif // NCMPCPP_DATABASE_CACHE_H
@@ -19,6 +19,8 @@
  ***************************************************************************/
 
 #include <cassert>
+#include <unordered_map>
+#include <boost/functional/hash.hpp>
 
 #include "curses/menu_impl.h"
 #include "screens/browser.h"
@@ -85,17 +87,16 @@ void setProperties(NC::Menu<T> &menu, const MPD::Song &s, const SongList &list,
 	separate_albums = false;
 	if (Config.playlist_separate_albums)
 	{
-		auto next = list.beginS() + drawn_pos + 1;
-		if (next != list.endS())
+		const MPD::Song *next = drawn_pos+1 < menu.size()
+			? list.songAt(drawn_pos+1)
+			: nullptr;
+		if (next != nullptr)
 		{
-			if (next->song() != nullptr)
-			{
-				// Draw a separator when the next album is different than the current
-				// one. In case there are two albums with the same name, but a different
-				// album artist, compare also album artists.
-				separate_albums = next->song()->getAlbum() != s.getAlbum()
-				               || next->song()->getAlbumArtist() != s.getAlbumArtist();
-			}
+			// Draw a separator when the next album is different than the current
+			// one. In case there are two albums with the same name, but a different
+			// album artist, compare also album artists.
+			separate_albums = next->peek(MPD_TAG_ALBUM) != s.peek(MPD_TAG_ALBUM)
+			               || next->peek(MPD_TAG_ALBUM_ARTIST) != s.peek(MPD_TAG_ALBUM_ARTIST);
 		}
 	}
 	if (separate_albums)
@@ -134,81 +135,101 @@ void unsetProperties(NC::Menu<T> &menu, bool separate_albums, bool is_now_playin
 		menu << NC::Format::NoUnderline;
 }
 
-template <typename T>
-void showSongs(NC::Menu<T> &menu, const MPD::Song &s, const SongList &list, const Format::AST<char> &ast)
+// Cache of songs rendered with a given layout, so that redrawing a list (e.g.
+// after the cursor moved) doesn't evaluate formats and convert tags of all
+// visible songs again. Properties of the item (now playing, selected etc.)
+// are applied on top of the cached line when it's drawn.
+template <typename ValueT>
+struct RenderCache
 {
-	bool separate_albums, is_now_playing, is_selected, is_in_playlist, discard_colors;
-	setProperties(menu, s, list, separate_albums, is_now_playing, is_selected,
-	              is_in_playlist, discard_colors);
-
-	const size_t y = menu.getY();
-	NC::Buffer right_aligned;
-	Format::print(ast, menu, &s, &right_aligned,
-		discard_colors ? Format::Flags::Tag | Format::Flags::OutputSwitch : Format::Flags::All
-	);
-	if (!right_aligned.str().empty())
+	template <typename RenderT>
+	const ValueT &get(const MPD::Song &s, const void *layout, int width,
+	                  bool discard_colors, RenderT render)
 	{
-		size_t x_off = menu.getWidth() - wideLength(ToWString(right_aligned.str()));
-		if (menu.isHighlighted() && list.currentS()->song() == &s)
+		// Entries hold a copy of the song, so its data can't be freed and
+		// reused by a different song while the entry exists.
+		Key key{s.c_song(), MPD::Song::Hash()(s), layout, width, discard_colors};
+		auto it = m_entries.find(key);
+		if (it == m_entries.end())
 		{
-			if (menu.highlightSuffix() == Config.current_item_suffix)
-				x_off -= Config.current_item_suffix_length;
-			else
-				x_off -= Config.current_item_inactive_column_suffix_length;
+			if (m_entries.size() >= max_size)
+				m_entries.clear();
+			it = m_entries.emplace(key, Entry()).first;
+			it->second.song = s;
+			render(it->second.value);
 		}
-		if (is_now_playing)
-			x_off -= Config.now_playing_suffix_length;
-		if (is_selected)
-			x_off -= Config.selected_item_suffix_length;
-		menu << NC::TermManip::ClearToEOL << NC::XY(x_off, y) << right_aligned;
+		return it->second.value;
 	}
 
-	unsetProperties(menu, separate_albums, is_now_playing, is_in_playlist);
-}
+private:
+	static const size_t max_size = 4096;
 
-template <typename T>
-void showSongsInColumns(NC::Menu<T> &menu, const MPD::Song &s, const SongList &list)
-{
-	if (Config.columns.empty())
-		return;
+	struct Key
+	{
+		bool operator==(const Key &rhs) const
+		{
+			return song == rhs.song
+				&& layout == rhs.layout
+				&& width == rhs.width
+				&& discard_colors == rhs.discard_colors;
+		}
 
-	bool separate_albums, is_now_playing, is_selected, is_in_playlist, discard_colors;
-	setProperties(menu, s, list, separate_albums, is_now_playing, is_selected,
-	              is_in_playlist, discard_colors);
+		const mpd_song *song;
+		size_t hash;
+		const void *layout;
+		int width;
+		bool discard_colors;
+	};
 
-	int menu_width = menu.getWidth();
-	if (menu.isHighlighted() && list.currentS()->song() == &s)
+	struct KeyHash
 	{
-		if (menu.highlightPrefix() == Config.current_item_prefix)
-			menu_width -= Config.current_item_prefix_length;
-		else
-			menu_width -= Config.current_item_inactive_column_prefix_length;
+		size_t operator()(const Key &key) const
+		{
+			size_t seed = key.hash;
+			boost::hash_combine(seed, key.layout);
+			boost::hash_combine(seed, key.width);
+			boost::hash_combine(seed, key.discard_colors);
+			return seed;
+		}
+	};
 
-		if (menu.highlightSuffix() == Config.current_item_suffix)
-			menu_width -= Config.current_item_suffix_length;
-		else
-			menu_width -= Config.current_item_inactive_column_suffix_length;
-	}
-	if (is_now_playing)
+	struct Entry
 	{
-		menu_width -= Config.now_playing_prefix_length;
-		menu_width -= Config.now_playing_suffix_length;
-	}
-	if (is_selected)
-	{
-		menu_width -= Config.selected_item_prefix_length;
-		menu_width -= Config.selected_item_suffix_length;
-	}
+		MPD::Song song;
+		ValueT value;
+	};
+
+	std::unordered_map<Key, Entry, KeyHash> m_entries;
+};
+
+struct RenderedSong
+{
+	NC::Buffer line;
+	NC::Buffer right_aligned;
+	size_t right_aligned_length;
+};
+
+RenderCache<RenderedSong> rendered_songs;
+RenderCache<NC::WBuffer> rendered_columns;
+
+void renderSong(RenderedSong &rendered, const MPD::Song &s,
+                const Format::AST<char> &ast, bool discard_colors)
+{
+	Format::print(ast, rendered.line, &rendered.right_aligned, &s,
+		discard_colors ? Format::Flags::Tag | Format::Flags::OutputSwitch : Format::Flags::All
+	);
+	rendered.right_aligned_length = wideLength(ToWString(rendered.right_aligned.str()));
+}
 
+void renderColumns(NC::WBuffer &line, const MPD::Song &s, int menu_width,
+                   bool discard_colors)
+{
 	int width;
-	int y = menu.getY();
 	int remained_width = menu_width;
 
 	std::vector<Column>::const_iterator it, last = Config.columns.end() - 1;
 	for (it = Config.columns.begin(); it != Config.columns.end(); ++it)
 	{
-		// check current X coordinate
-		int x = menu.getX();
 		// column has relative width and all after it have fixed width,
 		// so stretch it so it fills whole screen along with these after.
 		if (it->stretch_limit >= 0) // (*)
@@ -241,32 +262,102 @@ void showSongsInColumns(NC::Menu<T> &menu, const MPD::Song &s, const SongList &l
 		wideCut(tag, width);
 
 		if (!discard_colors && it->color != NC::Color::Default)
-			menu << it->color;
+			line << it->color;
 
-		int x_off = 0;
-		// if column uses right alignment, calculate proper offset.
-		// otherwise just assume offset is 0, ie. we start from the left.
+		// pad the tag with spaces to the width of the column, on the left
+		// side if column uses right alignment.
+		size_t padding = std::max(0, width - int(wideLength(tag)));
 		if (it->right_alignment)
-			x_off = std::max(0, width - int(wideLength(tag)));
-
-		whline(menu.raw(), NC::Key::Space, width);
-		menu.goToXY(x + x_off, y);
-		menu << tag;
-		menu.goToXY(x + width, y);
+			line << std::wstring(padding, NC::Key::Space) << tag;
+		else
+			line << tag << std::wstring(padding, NC::Key::Space);
 		if (it != last)
 		{
 			// add missing width's part and restore the value.
-			menu << ' ';
+			line << L' ';
 			remained_width -= width+1;
 		}
 
 		if (!discard_colors && it->color != NC::Color::Default)
-			menu << NC::Color::End;
+			line << NC::Color::End;
+	}
+}
+
+template <typename T>
+void showSongs(NC::Menu<T> &menu, const MPD::Song &s, const SongList &list, const Format::AST<char> &ast)
+{
+	bool separate_albums, is_now_playing, is_selected, is_in_playlist, discard_colors;
+	setProperties(menu, s, list, separate_albums, is_now_playing, is_selected,
+	              is_in_playlist, discard_colors);
+
+	const size_t y = menu.getY();
+	const RenderedSong &rendered = rendered_songs.get(
+		s, &ast, 0, discard_colors, [&](RenderedSong &r) {
+			renderSong(r, s, ast, discard_colors);
+		});
+	menu << rendered.line;
+	if (!rendered.right_aligned.str().empty())
+	{
+		size_t x_off = menu.getWidth() - rendered.right_aligned_length;
+		if (menu.isHighlighted() && list.currentSong() == &s)
+		{
+			if (menu.highlightSuffix() == Config.current_item_suffix)
+				x_off -= Config.current_item_suffix_length;
+			else
+				x_off -= Config.current_item_inactive_column_suffix_length;
+		}
+		if (is_now_playing)
+			x_off -= Config.now_playing_suffix_length;
+		if (is_selected)
+			x_off -= Config.selected_item_suffix_length;
+		menu << NC::TermManip::ClearToEOL << NC::XY(x_off, y) << rendered.right_aligned;
 	}
 
 	unsetProperties(menu, separate_albums, is_now_playing, is_in_playlist);
 }
 
+template <typename T>
+void showSongsInColumns(NC::Menu<T> &menu, const MPD::Song &s, const SongList &list)
+{
+	if (Config.columns.empty())
+		return;
+
+	bool separate_albums, is_now_playing, is_selected, is_in_playlist, discard_colors;
+	setProperties(menu, s, list, separate_albums, is_now_playing, is_selected,
+	              is_in_playlist, discard_colors);
+
+	int menu_width = menu.getWidth();
+	if (menu.isHighlighted() && list.currentSong() == &s)
+	{
+		if (menu.highlightPrefix() == Config.current_item_prefix)
+			menu_width -= Config.current_item_prefix_length;
+		else
+			menu_width -= Config.current_item_inactive_column_prefix_length;
+
+		if (menu.highlightSuffix() == Config.current_item_suffix)
+			menu_width -= Config.current_item_suffix_length;
+		else
+			menu_width -= Config.current_item_inactive_column_suffix_length;
+	}
+	if (is_now_playing)
+	{
+		menu_width -= Config.now_playing_prefix_length;
+		menu_width -= Config.now_playing_suffix_length;
+	}
+	if (is_selected)
+	{
+		menu_width -= Config.selected_item_prefix_length;
+		menu_width -= Config.selected_item_suffix_length;
+	}
+
+	menu << rendered_columns.get(
+		s, &Config.columns, menu_width, discard_colors, [&](NC::WBuffer &line) {
+			renderColumns(line, s, menu_width, discard_colors);
+		});
+
+	unsetProperties(menu, separate_albums, is_now_playing, is_in_playlist);
+}
+
 }
 
 std::string Display::Columns(size_t list_width)
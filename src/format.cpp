@@ -18,6 +18,7 @@
  *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
  ***************************************************************************/
 
+#include <algorithm>
 #include <stdexcept>
 
 #include "format_impl.h"
@@ -221,10 +222,101 @@ expressions<CharT> parseBracket(const string<CharT> &s,
 	return result;
 }
 
+template <typename CharT>
+struct Compiler: boost::static_visitor<>
+{
+	Compiler(Format::Program<CharT> &program)
+	: m_program(program)
+	, m_depth(0)
+	{ }
+
+	void operator()(const string<CharT> &s)
+	{
+		emit(Format::Opcode::String, m_program.strings.size());
+		m_program.strings.push_back(s);
+	}
+
+	void operator()(const NC::Color &c)
+	{
+		emit(Format::Opcode::Color, m_program.colors.size());
+		m_program.colors.push_back(c);
+	}
+
+	void operator()(NC::Format fmt)
+	{
+		emit(Format::Opcode::Format, static_cast<uint32_t>(fmt));
+	}
+
+	void operator()(Format::OutputSwitch)
+	{
+		emit(Format::Opcode::OutputSwitch, 0);
+	}
+
+	void operator()(const Format::SongTag &st)
+	{
+		emit(Format::Opcode::Tag, m_program.tags.size());
+		m_program.tags.push_back(st);
+	}
+
+	void operator()(const Format::Group<CharT> &group)
+	{
+		++m_depth;
+		m_program.max_depth = std::max(m_program.max_depth, m_depth);
+		size_t begin = emit(Format::Opcode::GroupBegin, 0);
+		std::vector<size_t> checks;
+		for (const auto &ex : group.base())
+		{
+			boost::apply_visitor(*this, ex);
+			checks.push_back(emit(Format::Opcode::GroupCheck, 0));
+		}
+		size_t end = emit(Format::Opcode::GroupEnd, begin+1);
+		for (size_t check : checks)
+			m_program.code[check].argument = end;
+		--m_depth;
+	}
+
+	void operator()(const Format::FirstOf<CharT> &first_of)
+	{
+		std::vector<size_t> jumps;
+		for (const auto &ex : first_of.base())
+		{
+			boost::apply_visitor(*this, ex);
+			jumps.push_back(emit(Format::Opcode::JumpIfOk, 0));
+		}
+		// Reached only if none of the expressions was Ok.
+		size_t end = emit(Format::Opcode::SetEmpty, 0) + 1;
+		for (size_t jump : jumps)
+			m_program.code[jump].argument = end;
+	}
+
+private:
+	size_t emit(Format::Opcode opcode, size_t argument)
+	{
+		m_program.code.emplace_back(opcode, argument);
+		return m_program.code.size() - 1;
+	}
+
+	Format::Program<CharT> &m_program;
+	size_t m_depth;
+};
+
 }
 
 namespace Format {
 
+template <typename CharT>
+Program<CharT> compile(const std::vector<Expression<CharT>> &expressions)
+{
+	Program<CharT> result;
+	Compiler<CharT> compiler(result);
+	for (const auto &ex : expressions)
+		boost::apply_visitor(compiler, ex);
+	return result;
+}
+
+template Program<char> compile(const std::vector<Expression<char>> &);
+template Program<wchar_t> compile(const std::vector<Expression<wchar_t>> &);
+
 AST<char> parse(const std::string &s, const unsigned flags)
 {
 	return AST<char>(parseBracket(s, s.begin(), s.end(), flags));
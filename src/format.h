@@ -21,6 +21,7 @@
 #ifndef NCMPCPP_HAVE_FORMAT_H
 #define NCMPCPP_HAVE_FORMAT_H
 
+#include <cstdint>
 #include <boost/variant.hpp>
 
 #include "curses/menu.h"
@@ -49,14 +50,18 @@ struct OutputSwitch { };
 struct SongTag
 {
 	SongTag(MPD::Song::GetFunction function_, unsigned delimiter_ = 0)
-	: m_function(function_), m_delimiter(delimiter_)
+	: m_function(function_)
+	, m_peek_function(MPD::Song::peekFunction(function_))
+	, m_delimiter(delimiter_)
 	{ }
 
 	MPD::Song::GetFunction function() const { return m_function; }
+	MPD::Song::PeekFunction peekFunction() const { return m_peek_function; }
 	unsigned delimiter() const { return m_delimiter; }
 
 private:
 	MPD::Song::GetFunction m_function;
+	MPD::Song::PeekFunction m_peek_function;
 	unsigned m_delimiter;
 };
 
@@ -106,8 +111,77 @@ private:
 	Base m_base;
 };
 
-template <typename CharT, typename VisitorT>
-void visit(VisitorT &visitor, const AST<CharT> &ast);
+// Flat form of an AST. Groups and FirstOf lists are lowered to forward jumps,
+// so printing is a single loop over the instruction array instead of a
+// recursive walk over nested variants.
+enum class Opcode : uint8_t
+{
+	// Leaves. The result of each of them is stored in the result register,
+	// argument is an index into the relevant constant table of the program
+	// (or the format itself in case of Format).
+	String, Color, Format, OutputSwitch, Tag,
+	// Start a group: push a new frame and disable the output.
+	GroupBegin,
+	// Add the result register to the result of the current group. If it
+	// becomes Missing, jump to the matching GroupEnd (argument).
+	GroupCheck,
+	// Finish a dry run of the group and, if its result is Ok and output is not
+	// disabled, jump back to its first instruction (argument) to do it again
+	// with output. Otherwise pop the frame and store its result.
+	GroupEnd,
+	// Jump to the argument if result of the last expression is Ok.
+	JumpIfOk,
+	// Set the result register to Empty.
+	SetEmpty,
+};
+
+struct Instruction
+{
+	Instruction(Opcode opcode_, uint32_t argument_)
+	: opcode(opcode_), argument(argument_)
+	{ }
+
+	Opcode opcode;
+	uint32_t argument;
+};
+
+template <typename CharT>
+struct Program
+{
+	Program() : max_depth(0) { }
+
+	std::vector<Instruction> code;
+	std::vector<std::basic_string<CharT>> strings;
+	std::vector<NC::Color> colors;
+	std::vector<SongTag> tags;
+
+	// Maximum nesting level of groups.
+	size_t max_depth;
+};
+
+template <typename CharT>
+Program<CharT> compile(const std::vector<Expression<CharT>> &expressions);
+
+// Top level expressions additionally carry their compiled form which is
+// what is actually used for printing.
+template <typename CharT>
+struct List<ListType::AST, CharT>
+{
+	typedef std::vector<Expression<CharT>> Base;
+
+	List() { }
+	List(Base &&base_)
+	: m_base(std::move(base_))
+	, m_program(compile(m_base))
+	{ }
+
+	const Base &base() const { return m_base; }
+	const Program<CharT> &program() const { return m_program; }
+
+private:
+	Base m_base;
+	Program<CharT> m_program;
+};
 
 template <typename CharT, typename ItemT>
 void print(const AST<CharT> &ast, NC::Menu<ItemT> &menu, const MPD::Song *song,
@@ -117,6 +191,11 @@ template <typename CharT>
 void print(const AST<CharT> &ast, NC::BasicBuffer<CharT> &buffer,
            const MPD::Song *song, const unsigned flags = Flags::All);
 
+template <typename CharT>
+void print(const AST<CharT> &ast, NC::BasicBuffer<CharT> &buffer,
+           NC::BasicBuffer<CharT> *second_buffer, const MPD::Song *song,
+           const unsigned flags = Flags::All);
+
 template <typename CharT>
 std::basic_string<CharT> stringify(const AST<CharT> &ast, const MPD::Song *song);
 
@@ -66,7 +66,7 @@ inline Result &operator+=(Result &base, Result result)
 }*/
 
 template <typename CharT, typename OutputT, typename SecondOutputT = OutputT>
-struct Printer: boost::static_visitor<Result>
+struct Printer
 {
 	typedef std::basic_string<CharT> StringT;
 
@@ -79,7 +79,108 @@ struct Printer: boost::static_visitor<Result>
 	, m_flags(flags)
 	{ }
 
-	Result operator()(const StringT &s)
+	void run(const Program<CharT> &program)
+	{
+		// Group semantics: if all Empty -> Empty, if any Ok -> continue with
+		// Ok, if any Missing -> stop with Empty. Each group is executed without
+		// output first to determine its result and then once again with output
+		// if the result is Ok.
+		struct Frame
+		{
+			Result result;
+			Result dry_result;
+			bool dry_run;
+		};
+		const size_t local_frames = 8;
+		Frame local[local_frames];
+		std::vector<Frame> heap;
+		Frame *frames = local;
+		if (program.max_depth > local_frames)
+		{
+			heap.resize(program.max_depth);
+			frames = heap.data();
+		}
+		// Index of one past the current frame.
+		size_t depth = 0;
+
+		Result result = Result::Empty;
+		const Instruction *code = program.code.data();
+		const size_t size = program.code.size();
+		for (size_t pc = 0; pc < size; ++pc)
+		{
+			const Instruction &in = code[pc];
+			switch (in.opcode)
+			{
+				case Opcode::String:
+					result = string(program.strings[in.argument]);
+					break;
+				case Opcode::Color:
+					if (m_flags & Flags::Color)
+						output(program.colors[in.argument]);
+					result = Result::Empty;
+					break;
+				case Opcode::Format:
+					if (m_flags & Flags::Format)
+						output(static_cast<NC::Format>(in.argument));
+					result = Result::Empty;
+					break;
+				case Opcode::OutputSwitch:
+					if (!m_no_output)
+						m_output_switched = true;
+					result = Result::Ok;
+					break;
+				case Opcode::Tag:
+					result = tag(program.tags[in.argument]);
+					break;
+				case Opcode::GroupBegin:
+					frames[depth++] = { Result::Empty, Result::Empty, true };
+					++m_no_output;
+					break;
+				case Opcode::GroupCheck:
+				{
+					Frame &frame = frames[depth-1];
+					frame.result += result;
+					if (frame.result == Result::Missing)
+					{
+						frame.result = Result::Empty;
+						pc = in.argument-1;
+					}
+					break;
+				}
+				case Opcode::GroupEnd:
+				{
+					Frame &frame = frames[depth-1];
+					if (frame.dry_run)
+					{
+						--m_no_output;
+						if (!m_no_output && frame.result == Result::Ok)
+						{
+							frame.dry_result = frame.result;
+							frame.result = Result::Empty;
+							frame.dry_run = false;
+							pc = in.argument-1;
+							break;
+						}
+						result = frame.result;
+					}
+					else
+						result = frame.dry_result;
+					--depth;
+					break;
+				}
+				case Opcode::JumpIfOk:
+					if (result == Result::Ok)
+						pc = in.argument-1;
+					break;
+				case Opcode::SetEmpty:
+					result = Result::Empty;
+					break;
+			}
+		}
+	}
+
+private:
+	Result string(const StringT &s)
 	{
 		if (!s.empty())
 		{
@@ -90,38 +191,27 @@ struct Printer: boost::static_visitor<Result>
 			return Result::Empty;
 	}
 
-	Result operator()(const NC::Color &c)
-	{
-		if (m_flags & Flags::Color)
-			output(c);
-		return Result::Empty;
-	}
-
-	Result operator()(NC::Format fmt)
-	{
-		if (m_flags & Flags::Format)
-			output(fmt);
-		return Result::Empty;
-	}
-
-	Result operator()(OutputSwitch)
+	Result tag(const SongTag &st)
 	{
-		if (!m_no_output)
-			m_output_switched = true;
-		return Result::Ok;
-	}
-
-	Result operator()(const SongTag &st)
-	{
-		StringT tags;
+		boost::string_ref tag;
 		if (m_flags & Flags::Tag && m_song != nullptr)
 		{
-			tags = convertString<CharT, char>::apply(
-				m_song->getTags(st.function())
-			);
+			if (st.peekFunction() != nullptr)
+				tag = m_song->peekTags(st.peekFunction(), m_tag_buffer);
+			else
+			{
+				m_tag_buffer = m_song->getTags(st.function());
+				tag = m_tag_buffer;
+			}
 		}
-		if (!tags.empty())
+		if (!tag.empty())
 		{
+			// Groups are executed without output first to determine whether
+			// all of their tags are present, there is no need to convert them
+			// then.
+			if (m_no_output)
+				return Result::Ok;
+			StringT tags = convertString<CharT, char>::apply(tag);
 			if (st.delimiter() > 0)
 			{
 				// shorten date/length by simple truncation
@@ -138,44 +228,6 @@ struct Printer: boost::static_visitor<Result>
 			return Result::Missing;
 	}
 
-	// If all Empty -> Empty, if any Ok -> continue with Ok, if any Missing ->
-	// stop with Empty.
-	Result operator()(const Group<CharT> &group)
-	{
-		auto visit = [this, &group] {
-			Result result = Result::Empty;
-			for (const auto &ex : group.base())
-			{
-				result += boost::apply_visitor(*this, ex);
-				if (result == Result::Missing)
-				{
-					result = Result::Empty;
-					break;
-				}
-			}
-			return result;
-		};
-
-		++m_no_output;
-		Result result = visit();
-		--m_no_output;
-		if (!m_no_output && result == Result::Ok)
-			visit();
-		return result;
-	}
-
-	// If all Empty or Missing -> Empty, if any Ok -> stop with Ok.
-	Result operator()(const FirstOf<CharT> &first_of)
-	{
-		for (const auto &ex : first_of.base())
-		{
-			if (boost::apply_visitor(*this, ex) == Result::Ok)
-				return Result::Ok;
-		}
-		return Result::Empty;
-	}
-
-private:
 	// generic version for streams (buffers, menus)
 	template <typename ValueT, typename OutputStreamT>
 	struct output_ {
@@ -251,21 +303,16 @@ private:
 
 	unsigned m_no_output;
 	const unsigned m_flags;
-};
 
-template <typename CharT, typename VisitorT>
-void visit(VisitorT &visitor, const AST<CharT> &ast)
-{
-	for (const auto &ex : ast.base())
-		boost::apply_visitor(visitor, ex);
-}
+	std::string m_tag_buffer;
+};
 
 template <typename CharT, typename ItemT>
 void print(const AST<CharT> &ast, NC::Menu<ItemT> &menu, const MPD::Song *song,
            NC::BasicBuffer<CharT> *buffer, const unsigned flags)
 {
 	Printer<CharT, NC::Menu<ItemT>, NC::Buffer> printer(menu, song, buffer, flags);
-	visit(printer, ast);
+	printer.run(ast.program());
 }
 
 template <typename CharT>
@@ -273,7 +320,16 @@ void print(const AST<CharT> &ast, NC::BasicBuffer<CharT> &buffer,
            const MPD::Song *song, const unsigned flags)
 {
 	Printer<CharT, NC::BasicBuffer<CharT>> printer(buffer, song, &buffer, flags);
-	visit(printer, ast);
+	printer.run(ast.program());
+}
+
+template <typename CharT>
+void print(const AST<CharT> &ast, NC::BasicBuffer<CharT> &buffer,
+           NC::BasicBuffer<CharT> *second_buffer, const MPD::Song *song,
+           const unsigned flags)
+{
+	Printer<CharT, NC::BasicBuffer<CharT>> printer(buffer, song, second_buffer, flags);
+	printer.run(ast.program());
 }
 
 template <typename CharT>
@@ -281,7 +337,7 @@ std::basic_string<CharT> stringify(const AST<CharT> &ast, const MPD::Song *song)
 {
 	std::basic_string<CharT> result;
 	Printer<CharT, std::basic_string<CharT>> printer(result, song, &result, Flags::Tag);
-	visit(printer, ast);
+	printer.run(ast.program());
 	return result;
 }
 
@@ -290,7 +346,7 @@ TagVector<CharT> flatten(const AST<CharT> &ast, const MPD::Song &song)
 {
 	TagVector<CharT> result;
 	Printer<CharT, TagVector<CharT>> printer(result, &song, &result, Flags::Tag);
-	visit(printer, ast);
+	printer.run(ast.program());
 	return result;
 }
 
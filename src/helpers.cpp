@@ -34,11 +34,7 @@ const MPD::Song *currentSong(const BaseScreen *screen)
 	const MPD::Song *ptr = nullptr;
 	const auto *list = dynamic_cast<const SongList *>(screen->activeWindow());
 	if (list != nullptr)
-	{
-		const auto it = list->currentS();
-		if (it != list->endS())
-			ptr = it->song();
-	}
+		ptr = list->currentSong();
 	return ptr;
 }
 
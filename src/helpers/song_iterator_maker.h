@@ -66,4 +66,18 @@ ConstSongIterator makeConstSongIterator(ConstIteratorT it)
 	return ConstSongIterator(boost::make_transform_iterator(it, Extractor{}));
 }
 
+template <typename ItemT>
+const MPD::Song *menuSongAt(const NC::Menu<ItemT> &menu, size_t pos)
+{
+	SongPropertiesExtractor<ItemT> extract;
+	const SongProperties &properties = extract(menu[pos]);
+	return properties.song();
+}
+
+template <typename ItemT>
+const MPD::Song *menuCurrentSong(const NC::Menu<ItemT> &menu)
+{
+	return menu.empty() ? nullptr : menuSongAt(menu, menu.choice());
+}
+
 #endif // NCMPCPP_HELPERS_SONG_ITERATOR_MAKER_H
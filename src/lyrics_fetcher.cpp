@@ -68,22 +68,36 @@ std::istream &operator>>(std::istream &is, LyricsFetcher_ &fetcher)
 const char LyricsFetcher::msgNotFound[] = "Not found";
 
 LyricsFetcher::Result LyricsFetcher::fetch(const std::string &artist,
-                                           const std::string &title)
+                                           const std::string &title) const
+{
+	Session session = start(artist, title);
+	while (!session.done)
+	{
+		std::string data;
+		CURLcode code = Curl::perform(data, session.url, session.referer,
+		                              session.follow_redirect);
+		process(session, code, data);
+	}
+	return session.result;
+}
+
+LyricsFetcher::Session LyricsFetcher::start(const std::string &artist,
+                                            const std::string &title) const
+{
+	Session session;
+	session.url = urlTemplate();
+	boost::replace_all(session.url, "%artist%", Curl::escape(artist));
+	boost::replace_all(session.url, "%title%", Curl::escape(title));
+	session.follow_redirect = true;
+	return session;
+}
+
+void LyricsFetcher::process(Session &session, CURLcode code, std::string &data) const
 {
-	Result result;
-	result.first = false;
-	
-	std::string url = urlTemplate();
-	boost::replace_all(url, "%artist%", Curl::escape(artist));
-	boost::replace_all(url, "%title%", Curl::escape(title));
-	
-	std::string data;
-	CURLcode code = Curl::perform(data, url, "", true);
-	
 	if (code != CURLE_OK)
 	{
-		result.second = curl_easy_strerror(code);
-		return result;
+		finish(session, false, curl_easy_strerror(code));
+		return;
 	}
 
 	auto lyrics = getContent(regex(), data);
@@ -93,8 +107,8 @@ LyricsFetcher::Result LyricsFetcher::fetch(const std::string &artist,
 		//std::cerr << "Data: " << data << "\n";
 		//std::cerr << "Empty: " << lyrics.empty() << "\n";
 		//std::cerr << "Not Lyrics: " << notLyrics(data) << "\n";
-		result.second = msgNotFound;
-		return result;
+		finish(session, false, msgNotFound);
+		return;
 	}
 
 	data.clear();
@@ -109,13 +123,18 @@ LyricsFetcher::Result LyricsFetcher::fetch(const std::string &artist,
 		}
 	}
 	
-	result.second = data;
-	result.first = true;
-	return result;
+	finish(session, true, std::move(data));
+}
+
+void LyricsFetcher::finish(Session &session, bool found, std::string result) const
+{
+	session.result.first = found;
+	session.result.second = std::move(result);
+	session.done = true;
 }
 
 std::vector<std::string> LyricsFetcher::getContent(const char *regex_,
-                                                   const std::string &data)
+                                                   const std::string &data) const
 {
 	std::vector<std::string> result;
 	boost::regex rx(regex_);
@@ -149,12 +168,9 @@ void LyricsFetcher::postProcess(std::string &data) const
 
 /**********************************************************************/
 
-LyricsFetcher::Result GoogleLyricsFetcher::fetch(const std::string &artist,
-                                                 const std::string &title)
+LyricsFetcher::Session GoogleLyricsFetcher::start(const std::string &artist,
+                                                  const std::string &title) const
 {
-	Result result;
-	result.first = false;
-	
 	std::string search_str;
 	if (siteKeyword() != nullptr)
 	{
@@ -168,41 +184,57 @@ LyricsFetcher::Result GoogleLyricsFetcher::fetch(const std::string &artist,
 	search_str += "+";
 	search_str += Curl::escape(title);
 	
-	std::string google_url = "http://www.google.com/search?hl=en&ie=UTF-8&oe=UTF-8&q=";
-	google_url += search_str;
-	google_url += "&btnI=I%27m+Feeling+Lucky";
-	
-	std::string data;
-	CURLcode code = Curl::perform(data, google_url, google_url);
-	
+	Session session;
+	session.url = "http://www.google.com/search?hl=en&ie=UTF-8&oe=UTF-8&q=";
+	session.url += search_str;
+	session.url += "&btnI=I%27m+Feeling+Lucky";
+	session.referer = session.url;
+	return session;
+}
+
+void GoogleLyricsFetcher::process(Session &session, CURLcode code, std::string &data) const
+{
+	std::string url;
+	if (session.step > 0)
+		LyricsFetcher::process(session, code, data);
+	else if (search(session, code, data, url))
+	{
+		session.url = unescapeHtmlUtf8(url);
+		session.referer.clear();
+		session.follow_redirect = true;
+		++session.step;
+	}
+}
+
+bool GoogleLyricsFetcher::search(Session &session, CURLcode code,
+                                 const std::string &data, std::string &url) const
+{
 	if (code != CURLE_OK)
 	{
-		result.second = curl_easy_strerror(code);
-		return result;
+		finish(session, false, curl_easy_strerror(code));
+		return false;
 	}
 
 	auto urls = getContent("<A HREF=\"http://www.google.com/url\\?q=(.*?)\">here</A>", data);
 
 	if (urls.empty() || !isURLOk(urls[0]))
 	{
-		result.second = msgNotFound;
-		return result;
+		finish(session, false, msgNotFound);
+		return false;
 	}
 
-	data = unescapeHtmlUtf8(urls[0]);
-
-	URL = data.c_str();
-	return LyricsFetcher::fetch("", "");
+	url = urls[0];
+	return true;
 }
 
-bool GoogleLyricsFetcher::isURLOk(const std::string &url)
+bool GoogleLyricsFetcher::isURLOk(const std::string &url) const
 {
 	return url.find(siteKeyword()) != std::string::npos;
 }
 
 /**********************************************************************/
 
-bool MetrolyricsFetcher::isURLOk(const std::string &url)
+bool MetrolyricsFetcher::isURLOk(const std::string &url) const
 {
 	// it sometimes return link to sitemap.xml, which is huge so we need to discard it
 	return GoogleLyricsFetcher::isURLOk(url) && url.find("sitemap") == std::string::npos;
@@ -210,19 +242,10 @@ bool MetrolyricsFetcher::isURLOk(const std::string &url)
 
 /**********************************************************************/
 
-LyricsFetcher::Result InternetLyricsFetcher::fetch(const std::string &artist,
-                                                   const std::string &title)
-{
-	GoogleLyricsFetcher::fetch(artist, title);
-	LyricsFetcher::Result result;
-	result.first = false;
-	result.second = "The following site may contain lyrics for this song: ";
-	result.second += URL;
-	return result;
-}
-
-bool InternetLyricsFetcher::isURLOk(const std::string &url)
+void InternetLyricsFetcher::process(Session &session, CURLcode code, std::string &data) const
 {
-	URL = url;
-	return false;
+	std::string url;
+	search(session, code, data, url);
+	finish(session, false,
+	       "The following site may contain lyrics for this song: " + url);
 }
@@ -25,15 +25,43 @@
 
 #include <memory>
 #include <string>
+#include <vector>
+#include "curl/curl.h"
 
 struct LyricsFetcher
 {
 	typedef std::pair<bool, std::string> Result;
 
+	// Fetching lyrics of a single song. It takes one or more requests, each of
+	// them depends on the response to the previous one.
+	struct Session
+	{
+		Session()
+		: follow_redirect(false), step(0), done(false)
+		{ }
+
+		// Request to make in the current step.
+		std::string url;
+		std::string referer;
+		bool follow_redirect;
+
+		size_t step;
+		bool done;
+		Result result;
+	};
+
 	virtual ~LyricsFetcher() { }
 
 	virtual const char *name() const = 0;
-	virtual Result fetch(const std::string &artist, const std::string &title);
+
+	// Fetch lyrics, performing requests one by one.
+	Result fetch(const std::string &artist, const std::string &title) const;
+
+	virtual Session start(const std::string &artist, const std::string &title) const;
+
+	// Process the response to the request of the current step. Either the result
+	// is set and the session is done or the request of the next step is set.
+	virtual void process(Session &session, CURLcode code, std::string &data) const;
 	
 protected:
 	virtual const char *urlTemplate() const = 0;
@@ -42,7 +70,9 @@ protected:
 	virtual bool notLyrics(const std::string &) const { return false; }
 	virtual void postProcess(std::string &data) const;
 	
-	std::vector<std::string> getContent(const char *regex, const std::string &data);
+	std::vector<std::string> getContent(const char *regex, const std::string &data) const;
+
+	void finish(Session &session, bool found, std::string result) const;
 	
 	static const char msgNotFound[];
 };
@@ -57,16 +87,20 @@ std::istream &operator>>(std::istream &is, LyricsFetcher_ &fetcher);
 
 struct GoogleLyricsFetcher : public LyricsFetcher
 {
-	virtual Result fetch(const std::string &artist, const std::string &title);
+	virtual Session start(const std::string &artist, const std::string &title) const override;
+	virtual void process(Session &session, CURLcode code, std::string &data) const override;
 	
 protected:
-	virtual const char *urlTemplate() const { return URL; }
+	// Address of the page with lyrics is the result of a search, so it's not
+	// known upfront.
+	virtual const char *urlTemplate() const override { return nullptr; }
 	virtual const char *siteKeyword() const { return name(); }
 	
-	virtual bool isURLOk(const std::string &url);
-	
-private:
-	const char *URL;
+	virtual bool isURLOk(const std::string &url) const;
+
+	// Search for a page with lyrics, returns false if it wasn't found.
+	bool search(Session &session, CURLcode code, const std::string &data,
+	            std::string &url) const;
 };
 
 struct MusixmatchFetcher : public GoogleLyricsFetcher
@@ -86,7 +120,7 @@ struct MetrolyricsFetcher : public GoogleLyricsFetcher
 protected:
 	virtual const char *regex() const override { return "<div class=\"lyrics-body\">(.*?)<!--WIDGET.*?<!-- Second Section -->(.*?)<!--WIDGET.*?<!-- Third Section -->(.*?)</div>"; }
 	
-	virtual bool isURLOk(const std::string &url) override;
+	virtual bool isURLOk(const std::string &url) const override;
 };
 
 struct Sing365Fetcher : public GoogleLyricsFetcher
@@ -156,16 +190,13 @@ protected:
 struct InternetLyricsFetcher : public GoogleLyricsFetcher
 {
 	virtual const char *name() const override { return "the Internet"; }
-	virtual Result fetch(const std::string &artist, const std::string &title) override;
+	virtual void process(Session &session, CURLcode code, std::string &data) const override;
 	
 protected:
 	virtual const char *siteKeyword() const override { return nullptr; }
 	virtual const char *regex() const override { return ""; }
 	
-	virtual bool isURLOk(const std::string &url) override;
-	
-private:
-	std::string URL;
+	virtual bool isURLOk(const std::string &) const override { return true; }
 };
 
 #endif // NCMPCPP_LYRICS_FETCHER_H
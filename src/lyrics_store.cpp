@@ -0,0 +1,643 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "lyrics_store.h"
+#include "settings.h"
+#include "utility/binary_io.h"
+#include "utility/string.h"
+
+namespace {
+
+// Store layout (see utility/binary_io.h for encoding of integers and
+// strings):
+//
+// header: magic, version
+// record: key, size of lyrics + 1 or 0 if they were removed, lyrics
+//
+// Records are only ever appended, the most recent record with a given key is
+// the valid one. Space taken by outdated records is reclaimed when the store
+// is loaded.
+//
+// The store may be shared by multiple instances of ncmpcpp, so appending and
+// rewriting it is done while holding an advisory lock on a separate lock
+// file. If the store was changed by another instance, which is detected by
+// its inode or size being different from what we expect, it is scanned again.
+const char store_magic[] = "ncmpcpp-lyrics";
+const uint64_t store_version = 1;
+
+// Position of lyrics within the store.
+struct Entry
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+// State of a file lyrics were exported to for editing. Lyrics are imported
+// back from the file when its state changes.
+struct ExportedFile
+{
+	ExportedFile()
+	: exists(false)
+	, mtime_sec(0)
+	, mtime_nsec(0)
+	, size(0)
+	{ }
+
+	bool operator==(const ExportedFile &rhs) const
+	{
+		return exists == rhs.exists
+			&& mtime_sec == rhs.mtime_sec
+			&& mtime_nsec == rhs.mtime_nsec
+			&& size == rhs.size;
+	}
+	bool operator!=(const ExportedFile &rhs) const { return !(*this == rhs); }
+
+	std::string path;
+	bool exists;
+	uint64_t mtime_sec;
+	uint64_t mtime_nsec;
+	uint64_t size;
+};
+
+struct Store
+{
+	Store()
+	: loaded(false)
+	, garbage(0)
+	, lock_fd(-1)
+	, inode(0)
+	, size(0)
+	{ }
+
+	bool loaded;
+	std::fstream file;
+	std::unordered_map<std::string, Entry> index;
+	// Size of outdated records.
+	uint64_t garbage;
+	// Files lyrics were exported to, by key.
+	std::unordered_map<std::string, ExportedFile> exported;
+
+	int lock_fd;
+	// Identity of the file the index was built from.
+	ino_t inode;
+	uint64_t size;
+	std::chrono::steady_clock::time_point last_check;
+};
+
+std::mutex store_mutex;
+Store store;
+
+// Checking whether the store was changed by another instance is rate limited
+// when only reading from it, so that presence checks don't touch the
+// filesystem each time.
+const auto check_interval = std::chrono::seconds(1);
+
+std::string storePath()
+{
+	return Config.lyrics_directory + "lyrics_store";
+}
+
+// List of exported files, so that they're imported back even if they're
+// modified after ncmpcpp exits.
+std::string exportedPath()
+{
+	return storePath() + ".exported";
+}
+
+// Advisory lock held while the store is modified or scanned.
+class FileLock
+{
+public:
+	FileLock()
+	: m_locked(false)
+	{
+		if (store.lock_fd < 0)
+		{
+			const std::string path = storePath() + ".lock";
+			store.lock_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		}
+		if (store.lock_fd >= 0)
+		{
+			while (flock(store.lock_fd, LOCK_EX) < 0)
+				if (errno != EINTR)
+					return;
+			m_locked = true;
+		}
+	}
+
+	~FileLock()
+	{
+		if (m_locked)
+			flock(store.lock_fd, LOCK_UN);
+	}
+
+private:
+	bool m_locked;
+};
+
+bool fileIdentity(const std::string &path, ino_t &inode, uint64_t &size)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) < 0)
+		return false;
+	inode = st.st_ino;
+	size = st.st_size;
+	return true;
+}
+
+void rememberIdentity(const std::string &path)
+{
+	if (!fileIdentity(path, store.inode, store.size))
+	{
+		store.inode = 0;
+		store.size = 0;
+	}
+	store.last_check = std::chrono::steady_clock::now();
+}
+
+// Undo a partially written record so that the records appended after it are
+// not lost when the store is scanned.
+void truncateStore(uint64_t size)
+{
+	const std::string path = storePath();
+	store.file.close();
+	boost::system::error_code ec;
+	boost::filesystem::resize_file(path, size, ec);
+	store.file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+}
+
+void writeHeader(std::ostream &os)
+{
+	writeString(os, store_magic);
+	writeNumber(os, store_version);
+}
+
+bool readHeader(std::istream &is)
+{
+	std::string magic;
+	uint64_t version;
+	return readString(is, magic) && magic == store_magic
+		&& readNumber(is, version) && version == store_version;
+}
+
+// Append a record and update the index. Lyrics are removed if they're null.
+// Needs to be called with the file lock held.
+bool appendRecord(const std::string &key, const std::string *lyrics)
+{
+	store.file.clear();
+	store.file.seekp(0, std::ios::end);
+	const uint64_t end = store.file.tellp();
+	if (!store.file)
+		return false;
+	writeString(store.file, key);
+	uint64_t offset = 0;
+	if (lyrics != nullptr)
+	{
+		writeNumber(store.file, lyrics->size() + 1);
+		offset = store.file.tellp();
+		store.file.write(lyrics->data(), lyrics->size());
+	}
+	else
+		writeNumber(store.file, 0);
+	store.file.flush();
+	if (!store.file)
+	{
+		truncateStore(end);
+		store.size = end;
+		return false;
+	}
+	store.size = store.file.tellp();
+
+	auto it = store.index.find(key);
+	if (it != store.index.end())
+	{
+		store.garbage += it->second.size;
+		store.index.erase(it);
+	}
+	if (lyrics != nullptr)
+		store.index[key] = Entry{offset, lyrics->size()};
+	return true;
+}
+
+bool readLyrics(const Entry &entry, std::string &lyrics)
+{
+	store.file.clear();
+	store.file.seekg(entry.offset);
+	lyrics.resize(entry.size);
+	return bool(store.file.read(&lyrics[0], entry.size));
+}
+
+bool readFile(const std::string &path, std::string &contents)
+{
+	std::ifstream input(path, std::ios::binary);
+	if (!input.is_open())
+		return false;
+	contents.assign(std::istreambuf_iterator<char>(input),
+	                std::istreambuf_iterator<char>());
+	return !input.bad();
+}
+
+ExportedFile exportedFileState(const std::string &path)
+{
+	ExportedFile file;
+	file.path = path;
+	struct stat st;
+	if (stat(path.c_str(), &st) == 0)
+	{
+		file.exists = true;
+#		ifdef __APPLE__
+		file.mtime_sec = st.st_mtimespec.tv_sec;
+		file.mtime_nsec = st.st_mtimespec.tv_nsec;
+#		else
+		file.mtime_sec = st.st_mtim.tv_sec;
+		file.mtime_nsec = st.st_mtim.tv_nsec;
+#		endif // __APPLE__
+		file.size = st.st_size;
+	}
+	return file;
+}
+
+void readExportedFiles()
+{
+	store.exported.clear();
+	std::ifstream input(exportedPath(), std::ios::binary);
+	std::string key;
+	ExportedFile file;
+	uint64_t exists;
+	while (readString(input, key)
+	       && readString(input, file.path)
+	       && readNumber(input, exists)
+	       && readNumber(input, file.mtime_sec)
+	       && readNumber(input, file.mtime_nsec)
+	       && readNumber(input, file.size))
+	{
+		file.exists = exists != 0;
+		store.exported[key] = file;
+	}
+}
+
+// Needs to be called with the file lock held.
+void writeExportedFiles()
+{
+	const std::string path = exportedPath();
+	const std::string tmp_path = path + ".tmp";
+	std::ofstream output(tmp_path, std::ios::binary | std::ios::trunc);
+	if (!output.is_open())
+		return;
+	for (const auto &file : store.exported)
+	{
+		writeString(output, file.first);
+		writeString(output, file.second.path);
+		writeNumber(output, file.second.exists);
+		writeNumber(output, file.second.mtime_sec);
+		writeNumber(output, file.second.mtime_nsec);
+		writeNumber(output, file.second.size);
+	}
+	output.close();
+	if (!output || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+		std::remove(tmp_path.c_str());
+}
+
+// Import lyrics from the exported file if it changed. Files that were removed
+// are forgotten. Needs to be called with the file lock held.
+bool importExportedFile(const std::string &key, ExportedFile &file, bool &modified)
+{
+	ExportedFile state = exportedFileState(file.path);
+	if (state == file)
+		return true;
+	modified = true;
+	if (!state.exists)
+	{
+		store.exported.erase(key);
+		return true;
+	}
+	std::string lyrics;
+	if (!readFile(state.path, lyrics) || !appendRecord(key, &lyrics))
+		return false;
+	file = std::move(state);
+	return true;
+}
+
+// Scan the store and build the index. A record truncated by an interrupted
+// write is discarded.
+enum class ScanResult { Ok, Invalid, Error };
+
+ScanResult scan(const std::string &path)
+{
+	std::ifstream input(path, std::ios::binary);
+	if (!input.is_open())
+		return ScanResult::Error;
+	if (!readHeader(input))
+		return ScanResult::Invalid;
+	uint64_t valid_size = input.tellg();
+	std::string key;
+	uint64_t size;
+	while (readString(input, key) && readNumber(input, size))
+	{
+		auto it = store.index.find(key);
+		if (it != store.index.end())
+		{
+			store.garbage += it->second.size;
+			store.index.erase(it);
+		}
+		if (size > 0)
+		{
+			uint64_t offset = input.tellg();
+			if (!input.ignore(size - 1) || uint64_t(input.gcount()) != size - 1)
+				break;
+			store.index[key] = Entry{offset, size - 1};
+		}
+		valid_size = input.tellg();
+	}
+	input.close();
+	boost::system::error_code ec;
+	if (valid_size < boost::filesystem::file_size(path, ec) && !ec)
+		boost::filesystem::resize_file(path, valid_size, ec);
+	return ec ? ScanResult::Error : ScanResult::Ok;
+}
+
+// Rewrite the store without outdated records. Needs to be called with the
+// file lock held.
+void compact(const std::string &path)
+{
+	const std::string tmp_path = path + ".tmp";
+	std::ofstream output(tmp_path, std::ios::binary | std::ios::trunc);
+	if (!output.is_open())
+		return;
+	writeHeader(output);
+	decltype(store.index) index;
+	std::string lyrics;
+	for (const auto &entry : store.index)
+	{
+		if (!readLyrics(entry.second, lyrics))
+			break;
+		writeString(output, entry.first);
+		writeNumber(output, lyrics.size() + 1);
+		index[entry.first] = Entry{uint64_t(output.tellp()), lyrics.size()};
+		output.write(lyrics.data(), lyrics.size());
+	}
+	output.close();
+	if (output && index.size() == store.index.size()
+	    && std::rename(tmp_path.c_str(), path.c_str()) == 0)
+	{
+		store.index = std::move(index);
+		store.garbage = 0;
+		store.file.close();
+		store.file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+		rememberIdentity(path);
+	}
+	else
+		std::remove(tmp_path.c_str());
+}
+
+// Import .txt files from lyrics_directory, which is how lyrics were stored
+// before.
+void importDirectory()
+{
+	boost::system::error_code ec;
+	boost::filesystem::directory_iterator it(Config.lyrics_directory, ec), end;
+	std::string lyrics;
+	for (; !ec && it != end; it.increment(ec))
+	{
+		const auto &path = it->path();
+		if (path.extension() != ".txt"
+		    || !boost::filesystem::is_regular_file(it->status()))
+			continue;
+		if (readFile(path.string(), lyrics))
+			appendRecord(LyricsStore::key(path.stem().string()), &lyrics);
+	}
+}
+
+// Build the index from scratch, creating the store if it doesn't exist. Needs
+// to be called with the file lock held.
+bool openStore(bool compact_store)
+{
+	const std::string path = storePath();
+	store.index.clear();
+	store.garbage = 0;
+	store.file.close();
+
+	// A store that can't be read (e.g. written by a different version) is
+	// moved aside instead of being overwritten, so that lyrics in it are not
+	// lost.
+	boost::system::error_code ec;
+	auto type = boost::filesystem::status(path, ec).type();
+	bool created = type == boost::filesystem::file_not_found;
+	if (ec && !created)
+		return false;
+	if (!created)
+	{
+		switch (scan(path))
+		{
+			case ScanResult::Ok:
+				break;
+			case ScanResult::Invalid:
+				boost::filesystem::rename(path, path + ".bad", ec);
+				if (ec)
+					return false;
+				created = true;
+				break;
+			case ScanResult::Error:
+				return false;
+		}
+	}
+	if (created)
+	{
+		store.index.clear();
+		store.garbage = 0;
+		std::ofstream output(path, std::ios::binary | std::ios::trunc);
+		writeHeader(output);
+		output.close();
+		if (!output)
+			return false;
+	}
+
+	store.file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+	if (!store.file.is_open())
+		return false;
+	rememberIdentity(path);
+
+	// Pick up lyrics edited while they were not watched.
+	readExportedFiles();
+	bool modified = false;
+	for (auto it = store.exported.begin(); it != store.exported.end();)
+	{
+		auto next = std::next(it);
+		importExportedFile(it->first, it->second, modified);
+		it = next;
+	}
+	if (modified)
+		writeExportedFiles();
+
+	if (created)
+		importDirectory();
+	else if (compact_store && store.garbage > 0)
+	{
+		// Compact the store if most of it is outdated.
+		uint64_t size = 0;
+		for (const auto &entry : store.index)
+			size += entry.second.size;
+		if (store.garbage > size)
+			compact(path);
+	}
+	return store.file.is_open();
+}
+
+// Whether the store was changed by another instance since we last looked.
+bool changed()
+{
+	ino_t inode;
+	uint64_t size;
+	return !store.file.is_open()
+		|| !fileIdentity(storePath(), inode, size)
+		|| inode != store.inode || size != store.size;
+}
+
+// Open the store on first use and make sure that the index is up to date
+// before reading from it.
+bool load()
+{
+	auto now = std::chrono::steady_clock::now();
+	if (store.loaded)
+	{
+		if (now - store.last_check < check_interval)
+			return store.file.is_open();
+		store.last_check = now;
+		if (!changed())
+			return true;
+	}
+	FileLock lock;
+	bool first = !store.loaded;
+	store.loaded = true;
+	return openStore(first);
+}
+
+// Same as load, but before writing to the store. The file lock needs to be
+// held by the caller.
+bool loadForWriting()
+{
+	if (store.loaded && !changed())
+		return true;
+	bool first = !store.loaded;
+	store.loaded = true;
+	return openStore(first);
+}
+
+}
+
+namespace LyricsStore {
+
+std::string key(std::string name)
+{
+	// Characters that are not allowed in file names on any system were
+	// removed from names of the imported files.
+	removeInvalidCharsFromFilename(name, true);
+	boost::algorithm::to_lower(name, std::locale::classic());
+	return name;
+}
+
+bool contains(const std::string &key)
+{
+	std::lock_guard<std::mutex> lock(store_mutex);
+	return load() && store.index.count(key) > 0;
+}
+
+boost::optional<std::string> get(const std::string &key)
+{
+	boost::optional<std::string> result;
+	std::lock_guard<std::mutex> lock(store_mutex);
+	if (!load())
+		return result;
+	auto it = store.index.find(key);
+	if (it != store.index.end())
+	{
+		std::string lyrics;
+		if (readLyrics(it->second, lyrics))
+			result = std::move(lyrics);
+	}
+	return result;
+}
+
+bool put(const std::string &key, const std::string &lyrics)
+{
+	std::lock_guard<std::mutex> lock(store_mutex);
+	FileLock file_lock;
+	return loadForWriting() && appendRecord(key, &lyrics);
+}
+
+bool remove(const std::string &key)
+{
+	std::lock_guard<std::mutex> lock(store_mutex);
+	FileLock file_lock;
+	if (!loadForWriting())
+		return false;
+	if (store.index.count(key) == 0)
+		return true;
+	return appendRecord(key, nullptr);
+}
+
+void exportedTo(const std::string &key, const std::string &path)
+{
+	std::lock_guard<std::mutex> lock(store_mutex);
+	FileLock file_lock;
+	if (!loadForWriting())
+		return;
+	store.exported[key] = exportedFileState(path);
+	writeExportedFiles();
+}
+
+bool importExported(const std::string &key)
+{
+	std::lock_guard<std::mutex> lock(store_mutex);
+	if (!load())
+		return false;
+	auto it = store.exported.find(key);
+	if (it == store.exported.end()
+	    || exportedFileState(it->second.path) == it->second)
+		return true;
+	FileLock file_lock;
+	if (!loadForWriting())
+		return false;
+	it = store.exported.find(key);
+	if (it == store.exported.end())
+		return true;
+	bool modified = false;
+	bool result = importExportedFile(key, it->second, modified);
+	if (modified)
+		writeExportedFiles();
+	return result;
+}
+
+}
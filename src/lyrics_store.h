@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#ifndef NCMPCPP_LYRICS_STORE_H
+#define NCMPCPP_LYRICS_STORE_H
+
+#include <boost/optional.hpp>
+#include <string>
+
+// Downloaded lyrics kept in a single file within lyrics_directory, keyed by
+// normalized "artist - title" of songs. The file is scanned once and the
+// index of its contents is kept in memory, so checking for presence of lyrics
+// doesn't touch the filesystem. The file is scanned again if it was changed
+// by another instance of ncmpcpp. When the store is created, lyrics from the
+// .txt files in lyrics_directory are imported into it. All functions are
+// thread safe.
+namespace LyricsStore {
+
+// Normalize name of lyrics, i.e. "artist - title" or name of the song file, to
+// a key of the store.
+std::string key(std::string name);
+
+bool contains(const std::string &key);
+
+boost::optional<std::string> get(const std::string &key);
+
+bool put(const std::string &key, const std::string &lyrics);
+
+bool remove(const std::string &key);
+
+// Remember that lyrics with the given key were exported to a file for
+// editing, so that they're imported back once the file is modified, also in
+// later sessions.
+void exportedTo(const std::string &key, const std::string &path);
+
+// Import lyrics with the given key from the file they were exported to if it
+// was modified since. Returns false if it was, but importing failed.
+bool importExported(const std::string &key);
+
+}
+
+#endif // NCMPCPP_LYRICS_STORE_H
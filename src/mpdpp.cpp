@@ -21,13 +21,17 @@
 #include <cassert>
 #include <cstdlib>
 #include <algorithm>
+#include <condition_variable>
 #include <map>
-#include <boost/regex.hpp>
+#include <mutex>
+#include <queue>
+#include <thread>
 
 #include "charset.h"
 #include "mpdpp.h"
 
 MPD::Connection Mpd;
+MPD::Worker MpdWorker(Mpd);
 
 namespace {
 
@@ -57,6 +61,23 @@ defaultFetcher(SourceT *(fetcher)(mpd_connection *))
 	};
 }
 
+// Reservoir sampling: after offering n values, each of them is in the sample
+// with equal probability, yet only the sample itself is kept in memory.
+template <typename ValueT>
+void offerSample(std::vector<ValueT> &sample, size_t number, size_t &n,
+                 ValueT value, std::mt19937 &rng)
+{
+	if (sample.size() < number)
+		sample.push_back(std::move(value));
+	else
+	{
+		size_t i = std::uniform_int_distribution<size_t>(0, n)(rng);
+		if (i < number)
+			sample[i] = std::move(value);
+	}
+	++n;
+}
+
 bool fetchItemSong(MPD::SongIterator::State &state)
 {
 	auto src = mpd_recv_entity(state.connection());
@@ -382,6 +403,35 @@ SongIterator Connection::GetPlaylistChanges(unsigned version)
 	return SongIterator(m_connection.get(), defaultFetcher<Song>(mpd_recv_song));
 }
 
+std::vector<std::pair<unsigned, unsigned>> Connection::GetPlaylistChangesPosId(unsigned version)
+{
+	prechecksNoCommandsList();
+	std::vector<std::pair<unsigned, unsigned>> result;
+	mpd_send_queue_changes_brief(m_connection.get(), version);
+	unsigned pos, id;
+	while (mpd_recv_queue_change_brief(m_connection.get(), &pos, &id))
+		result.emplace_back(pos, id);
+	mpd_response_finish(m_connection.get());
+	checkErrors();
+	return result;
+}
+
+std::vector<Song> Connection::GetPlaylistSongs(const std::vector<unsigned> &ids)
+{
+	prechecksNoCommandsList();
+	std::vector<Song> result;
+	result.reserve(ids.size());
+	mpd_command_list_begin(m_connection.get(), false);
+	for (const auto &id : ids)
+		mpd_send_get_queue_song_id(m_connection.get(), id);
+	mpd_command_list_end(m_connection.get());
+	while (mpd_song *s = mpd_recv_song(m_connection.get()))
+		result.push_back(Song(s));
+	mpd_response_finish(m_connection.get());
+	checkErrors();
+	return result;
+}
+
 Song Connection::GetCurrentSong()
 {
 	prechecksNoCommandsList();
@@ -583,65 +633,42 @@ bool Connection::Add(const std::string &path)
 
 bool Connection::AddRandomTag(mpd_tag_type tag, size_t number, std::mt19937 &rng)
 {
-	std::vector<std::string> tags(
-		std::make_move_iterator(GetList(tag)),
-		std::make_move_iterator(StringIterator())
-	);
+	std::vector<std::string> tags;
+	size_t n = 0;
+	for (StringIterator it = GetList(tag), end; it != end; ++it)
+		offerSample(tags, number, n, std::move(*it), rng);
 	if (number > tags.size())
 		return false;
 
+	// Let MPD add songs with chosen tags itself, all in a single command list.
 	std::shuffle(tags.begin(), tags.end(), rng);
-	auto it = tags.begin();
-	for (size_t i = 0; i < number && it != tags.end(); ++i)
+	StartCommandsList();
+	for (const auto &value : tags)
 	{
-		StartSearch(true);
-		AddSearch(tag, *it++);
-		std::vector<std::string> paths;
-		MPD::SongIterator s = CommitSearchSongs(), end;
-		for (; s != end; ++s)
-			paths.push_back(s->getURI());
-		StartCommandsList();
-		for (const auto &path : paths)
-			AddSong(path);
-		CommitCommandsList();
+		mpd_search_add_db_songs(m_connection.get(), true);
+		mpd_search_add_tag_constraint(m_connection.get(), MPD_OPERATOR_DEFAULT, tag, value.c_str());
+		mpd_search_commit(m_connection.get());
 	}
+	CommitCommandsList();
 	return true;
 }
 
-bool Connection::AddRandomSongs(size_t number, const std::string &random_exclude_pattern, std::mt19937 &rng)
+std::vector<std::string> Connection::GetRandomSongPaths(size_t number, const std::function<bool(const char *)> &accept, std::mt19937 &rng)
 {
 	prechecksNoCommandsList();
-	std::vector<std::string> files;
+	std::vector<std::string> paths;
+	size_t n = 0;
 	mpd_send_list_all(m_connection.get(), "/");
 	while (mpd_pair *item = mpd_recv_pair_named(m_connection.get(), "file"))
 	{
-		files.push_back(item->value);
+		if (accept(item->value))
+			offerSample(paths, number, n, std::string(item->value), rng);
 		mpd_return_pair(m_connection.get(), item);
 	}
 	mpd_response_finish(m_connection.get());
 	checkErrors();
-	
-	if (number > files.size())
-	{
-		//if (itsErrorHandler)
-		//	itsErrorHandler(this, 0, "Requested number of random songs is bigger than size of your library", itsErrorHandlerUserdata);
-		return false;
-	}
-	else
-	{
-		std::shuffle(files.begin(), files.end(), rng);
-		StartCommandsList();
-		auto it = files.begin();
-		boost::regex re(random_exclude_pattern);
-		for (size_t i = 0; i < number && it != files.end(); ++it) {
-			if (random_exclude_pattern.empty() || !boost::regex_match((*it), re)) {
-				AddSong(*it);
-				i++;
-			}
-		}
-		CommitCommandsList();
-	}
-	return true;
+	std::shuffle(paths.begin(), paths.end(), rng);
+	return paths;
 }
 
 void Connection::Delete(unsigned pos)
@@ -899,4 +926,141 @@ void Connection::checkErrors() const
 	checkConnectionErrors(m_connection.get());
 }
 
+/*************************************************************************/
+
+namespace {
+
+Worker::Callback rethrowError(std::exception_ptr error, Worker::ErrorCallback error_callback)
+{
+	return [error, error_callback] {
+		if (error_callback)
+			error_callback();
+		std::rethrow_exception(error);
+	};
+}
+
+}
+
+struct Worker::State
+{
+	State()
+	: running(false), stop(false)
+	{ }
+
+	std::mutex mutex;
+	std::condition_variable jobs_available;
+	std::queue<std::pair<Job, ErrorCallback>> jobs;
+	std::queue<Callback> results;
+	bool running;
+	bool stop;
+
+	// Accessed only by the worker thread.
+	Connection connection;
+};
+
+void Worker::run(std::shared_ptr<State> state)
+{
+	while (true)
+	{
+		Job job;
+		ErrorCallback error_callback;
+		{
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->jobs_available.wait(lock, [&state] {
+				return state->stop || !state->jobs.empty();
+			});
+			if (state->stop)
+				break;
+			job = std::move(state->jobs.front().first);
+			error_callback = std::move(state->jobs.front().second);
+			state->jobs.pop();
+		}
+		Callback callback;
+		try
+		{
+			callback = job(state->connection);
+		}
+		catch (ClientError &e)
+		{
+			// Reconnect when the next query is run.
+			if (!e.clearable())
+				state->connection.Disconnect();
+			callback = rethrowError(std::current_exception(), error_callback);
+		}
+		catch (...)
+		{
+			callback = rethrowError(std::current_exception(), error_callback);
+		}
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->results.push(std::move(callback));
+	}
+}
+
+Worker::Worker(const Connection &main)
+: m_main(main)
+, m_state(std::make_shared<State>())
+{
+}
+
+Worker::~Worker()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		m_state->stop = true;
+	}
+	m_state->jobs_available.notify_one();
+}
+
+void Worker::push(Job job, ErrorCallback error_callback)
+{
+	// Parameters of the main connection are read here as they can't be safely
+	// accessed from the worker thread.
+	auto host = m_main.GetHostname();
+	auto port = m_main.GetPort();
+	auto timeout = m_main.GetTimeout();
+	auto password = m_main.GetPassword();
+	auto connected_job = [=](Connection &c) {
+		if (c.Connected() && (c.GetHostname() != host || c.GetPort() != port))
+			c.Disconnect();
+		if (!c.Connected())
+		{
+			c.SetHostname(host);
+			c.SetPort(port);
+			c.SetTimeout(timeout);
+			c.SetPassword(password);
+			c.Connect();
+		}
+		return job(c);
+	};
+	{
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		m_state->jobs.emplace(std::move(connected_job), std::move(error_callback));
+		if (!m_state->running)
+		{
+			// The thread holds its own reference to the state, so it can safely
+			// outlive the worker at exit.
+			std::thread t(run, m_state);
+			t.detach();
+			m_state->running = true;
+		}
+	}
+	m_state->jobs_available.notify_one();
+}
+
+void Worker::processResults()
+{
+	while (true)
+	{
+		Callback callback;
+		{
+			std::lock_guard<std::mutex> lock(m_state->mutex);
+			if (m_state->results.empty())
+				break;
+			callback = std::move(m_state->results.front());
+			m_state->results.pop();
+		}
+		callback();
+	}
+}
+
 }
@@ -23,6 +23,8 @@
 
 #include <cassert>
 #include <exception>
+#include <functional>
+#include <memory>
 #include <random>
 #include <set>
 #include <stdexcept>
@@ -495,8 +497,10 @@ struct Connection
 	bool Connected() const;
 	void Disconnect();
 	
-	const std::string &GetHostname() { return m_host; }
-	int GetPort() { return m_port; }
+	const std::string &GetHostname() const { return m_host; }
+	int GetPort() const { return m_port; }
+	int GetTimeout() const { return m_timeout; }
+	const std::string &GetPassword() const { return m_password; }
 	
 	unsigned Version() const;
 	
@@ -529,6 +533,10 @@ struct Connection
 	void ClearMainPlaylist();
 	
 	SongIterator GetPlaylistChanges(unsigned);
+	// Positions and ids of songs changed since the given playlist version.
+	std::vector<std::pair<unsigned, unsigned>> GetPlaylistChangesPosId(unsigned);
+	// Songs in the playlist with given ids, all fetched in a single request.
+	std::vector<Song> GetPlaylistSongs(const std::vector<unsigned> &ids);
 	
 	Song GetCurrentSong();
 	Song GetSong(const std::string &);
@@ -553,7 +561,6 @@ struct Connection
 	int AddSong(const std::string &, int = -1); // returns id of added song
 	int AddSong(const Song &, int = -1); // returns id of added song
 	bool AddRandomTag(mpd_tag_type, size_t, std::mt19937 &rng);
-	bool AddRandomSongs(size_t number, const std::string &random_exclude_pattern, std::mt19937 &rng);
 	bool Add(const std::string &path);
 	void Delete(unsigned int pos);
 	void DeleteRange(unsigned begin, unsigned end);
@@ -581,6 +588,9 @@ struct Connection
 	StringIterator GetList(mpd_tag_type type);
 	ItemIterator GetDirectory(const std::string &directory);
 	SongIterator GetDirectoryRecursive(const std::string &directory);
+	// Pick at most the given number of random paths of songs in the database
+	// for which accept returns true. Only the chosen paths are kept in memory.
+	std::vector<std::string> GetRandomSongPaths(size_t number, const std::function<bool(const char *)> &accept, std::mt19937 &rng);
 	SongIterator GetSongs(const std::string &directory);
 	DirectoryIterator GetDirectories(const std::string &directory);
 	
@@ -620,8 +630,51 @@ private:
 	std::string m_password;
 };
 
+// Secondary connection with its own thread used for long read-only queries
+// (e.g. listallinfo), so that they don't stall idle handling and commands
+// sent through the main connection. Results of queries are handed back to
+// the UI thread through a queue and passed to their callbacks there.
+struct Worker
+{
+	typedef std::function<void()> Callback;
+	typedef std::function<Callback(Connection &)> Job;
+	typedef std::function<void()> ErrorCallback;
+
+	Worker(const Connection &main);
+	~Worker();
+
+	// Schedule query to be run on the worker connection. Its result is passed
+	// to callback during a subsequent call to processResults. If the query (or
+	// connecting to MPD) throws, error_callback is run there instead before the
+	// exception is rethrown. Queries are run in order of submission.
+	template <typename QueryT, typename CallbackT>
+	void submit(QueryT query, CallbackT callback, ErrorCallback error_callback = nullptr)
+	{
+		push([query, callback](Connection &c) -> Callback {
+			auto result = query(c);
+			return [callback, result]() mutable {
+				callback(std::move(result));
+			};
+		}, std::move(error_callback));
+	}
+
+	// Run callbacks of finished queries. If a query threw an exception, its
+	// error callback is run and the exception is rethrown here.
+	void processResults();
+
+private:
+	struct State;
+
+	static void run(std::shared_ptr<State> state);
+	void push(Job job, ErrorCallback error_callback);
+
+	const Connection &m_main;
+	std::shared_ptr<State> m_state;
+};
+
 }
 
 extern MPD::Connection Mpd;
+extern MPD::Worker MpdWorker;
 
 #endif // NCMPCPP_MPDPP_H
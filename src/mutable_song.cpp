@@ -84,6 +84,72 @@ std::string MutableSong::getComment(unsigned idx) const
 	return getTag(MPD_TAG_COMMENT, [this, idx](){ return Song::getComment(idx); }, idx);
 }
 
+boost::string_ref MutableSong::peekArtist(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_ARTIST, [this, idx, &buffer](){ return Song::peekArtist(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekTitle(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_TITLE, [this, idx, &buffer](){ return Song::peekTitle(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekAlbum(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_ALBUM, [this, idx, &buffer](){ return Song::peekAlbum(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekAlbumArtist(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_ALBUM_ARTIST, [this, idx, &buffer](){ return Song::peekAlbumArtist(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekTrack(unsigned idx, std::string &buffer) const
+{
+	auto it = m_tags.find(Tag(MPD_TAG_TRACK, idx));
+	if (it == m_tags.end())
+		return Song::peekTrack(idx, buffer);
+	const std::string &track = it->second;
+	if ((track.length() == 1 && track[0] != '0')
+	||  (track.length() > 3  && track[1] == '/'))
+	{
+		buffer = "0"+track;
+		return buffer;
+	}
+	else
+		return track;
+}
+
+boost::string_ref MutableSong::peekDate(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_DATE, [this, idx, &buffer](){ return Song::peekDate(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekGenre(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_GENRE, [this, idx, &buffer](){ return Song::peekGenre(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekComposer(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_COMPOSER, [this, idx, &buffer](){ return Song::peekComposer(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekPerformer(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_PERFORMER, [this, idx, &buffer](){ return Song::peekPerformer(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekDisc(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_DISC, [this, idx, &buffer](){ return Song::peekDisc(idx, buffer); }, idx);
+}
+
+boost::string_ref MutableSong::peekComment(unsigned idx, std::string &buffer) const
+{
+	return peekTag(MPD_TAG_COMMENT, [this, idx, &buffer](){ return Song::peekComment(idx, buffer); }, idx);
+}
+
 void MutableSong::setArtist(const std::string &value, unsigned idx)
 {
 	replaceTag(MPD_TAG_ARTIST, Song::getArtist(idx), value, idx);
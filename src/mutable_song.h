@@ -45,6 +45,18 @@ struct MutableSong : public Song
 	virtual std::string getPerformer(unsigned idx = 0) const override;
 	virtual std::string getDisc(unsigned idx = 0) const override;
 	virtual std::string getComment(unsigned idx = 0) const override;
+
+	virtual boost::string_ref peekArtist(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekTitle(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekAlbum(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekAlbumArtist(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekTrack(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekDate(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekGenre(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekComposer(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekPerformer(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekDisc(unsigned idx, std::string &buffer) const override;
+	virtual boost::string_ref peekComment(unsigned idx, std::string &buffer) const override;
 	
 	void setArtist(const std::string &value, unsigned idx = 0);
 	void setTitle(const std::string &value, unsigned idx = 0);
@@ -105,6 +117,15 @@ private:
 		return result;
 	}
 	
+	template <typename F>
+	boost::string_ref peekTag(mpd_tag_type tag_type, F orig_value, unsigned idx) const {
+		auto it = m_tags.find(Tag(tag_type, idx));
+		if (it == m_tags.end())
+			return orig_value();
+		else
+			return it->second;
+	}
+	
 	std::string m_name;
 	time_t m_mtime;
 	unsigned m_duration;
@@ -70,6 +70,12 @@ void sighandler(int sig)
 
 void do_at_exit()
 {
+#	ifdef ENABLE_VISUALIZER
+	// Threads of the visualizer use global state, stop them before it's
+	// destroyed.
+	if (myVisualizer != nullptr)
+		myVisualizer->CloseDataSource();
+#	endif // ENABLE_VISUALIZER
 	// restore old cerr & clog buffers
 	std::cerr.rdbuf(cerr_buffer);
 	std::clog.rdbuf(clog_buffer);
@@ -31,42 +31,18 @@
 # include <boost/regex.hpp>
 #endif // BOOST_REGEX_ICU
 
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "utility/functional.h"
 
-namespace {
-
-#ifdef BOOST_REGEX_ICU
-
-struct StripDiacritics
-{
-	static void convert(icu::UnicodeString &s)
-	{
-		if (m_converter == nullptr)
-		{
-			icu::ErrorCode result;
-			m_converter = icu::Transliterator::createInstance(
-				"NFD; [:M:] Remove; NFC", UTRANS_FORWARD, result);
-			if (result.isFailure())
-				throw std::runtime_error(
-					"instantiation of transliterator instance failed with "
-					+ std::string(result.errorName()));
-		}
-		m_converter->transliterate(s);
-	}
-
-private:
-	static icu::Transliterator *m_converter;
-};
-
-icu::Transliterator *StripDiacritics::m_converter;
-
-#endif // BOOST_REGEX_ICU
-
-}
-
 namespace Regex {
 
 typedef
@@ -90,6 +66,86 @@ inline Regex make(StringT &&s,
 	(std::forward<StringT>(s), flags);
 }
 
+#ifdef BOOST_REGEX_ICU
+
+// Strips diacritics from strings and remembers the results, so that searching
+// through the same strings over and over again (e.g. when filtering as you
+// type) doesn't need to run the transliterator each time. Safe to use from
+// multiple threads.
+struct StripDiacritics
+{
+	static StripDiacritics &instance()
+	{
+		static StripDiacritics strip_diacritics;
+		return strip_diacritics;
+	}
+
+	// Returns s without diacritics or an empty string if it doesn't contain
+	// any, in which case s can be used directly.
+	std::string operator()(boost::string_ref s)
+	{
+		// Quick path for the most common case.
+		if (std::all_of(s.begin(), s.end(), [](char c) { return (c & 0x80) == 0; }))
+			return std::string();
+
+		size_t hash = boost::hash_range(s.begin(), s.end());
+		Shard &shard = m_shards[hash % m_shards.size()];
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto it = shard.strings.find(hash);
+			if (it != shard.strings.end() && it->second.first == s)
+				return it->second.second;
+		}
+
+		std::string result;
+		auto us = icu::UnicodeString::fromUTF8(icu::StringPiece(s.data(), s.size()));
+		convert(us);
+		us.toUTF8String(result);
+		if (result == s)
+			result.clear();
+
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			// Keep memory usage in check, the strings will be recomputed if needed.
+			if (shard.strings.size() >= max_shard_size)
+				shard.strings.clear();
+			shard.strings[hash] = std::make_pair(s.to_string(), result);
+		}
+		return result;
+	}
+
+	static void convert(icu::UnicodeString &s)
+	{
+		// Transliterators are not thread safe and filtering of menus is done
+		// in parallel, so each thread needs its own instance.
+		thread_local std::unique_ptr<icu::Transliterator> converter;
+		if (converter == nullptr)
+		{
+			icu::ErrorCode result;
+			converter.reset(icu::Transliterator::createInstance(
+				"NFD; [:M:] Remove; NFC", UTRANS_FORWARD, result));
+			if (result.isFailure())
+				throw std::runtime_error(
+					"instantiation of transliterator instance failed with "
+					+ std::string(result.errorName()));
+		}
+		converter->transliterate(s);
+	}
+
+private:
+	static const size_t max_shard_size = 1 << 15;
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<size_t, std::pair<std::string, std::string>> strings;
+	};
+
+	std::array<Shard, 16> m_shards;
+};
+
+#endif // BOOST_REGEX_ICU
+
 template <typename CharT>
 inline bool search(const std::basic_string<CharT> &s,
                    const Regex &rx,
@@ -120,6 +176,42 @@ inline bool search(const std::basic_string<CharT> &s,
 	}
 }
 
+// Version for UTF-8 strings, e.g. tags returned by MPD::Song::peek*
+// accessors. It doesn't allocate unless diacritics need to be stripped.
+inline bool search(boost::string_ref s,
+                   const Regex &rx,
+                   bool ignore_diacritics)
+{
+	try {
+#ifdef BOOST_REGEX_ICU
+		if (ignore_diacritics)
+		{
+			std::string stripped = StripDiacritics::instance()(s);
+			if (!stripped.empty())
+				return boost::u32regex_search(stripped.begin(), stripped.end(), rx);
+		}
+		return boost::u32regex_search(s.begin(), s.end(), rx);
+#else
+		return boost::regex_search(s.begin(), s.end(), rx);
+#endif // BOOST_REGEX_ICU
+	} catch (std::out_of_range &e) {
+		// Invalid UTF-8 sequence, ignore the string.
+		std::cerr << "Regex::search: error while processing \""
+		          << s
+		          << "\": "
+		          << e.what()
+		          << "\n";
+		return false;
+	}
+}
+
+inline bool search(const std::string &s,
+                   const Regex &rx,
+                   bool ignore_diacritics)
+{
+	return search(boost::string_ref(s), rx, ignore_diacritics);
+}
+
 template <typename T>
 struct Filter
 {
@@ -135,6 +227,7 @@ struct Filter
 	       FilterT &&filter)
 		: m_rx(make(constraint_, flags))
 		, m_constraint(constraint_)
+		, m_flags(flags)
 		, m_filter(std::forward<FilterT>(filter))
 	{ }
 
@@ -147,6 +240,10 @@ struct Filter
 		return m_constraint;
 	}
 
+	boost::regex_constants::syntax_option_type flags() const {
+		return m_flags;
+	}
+
 	bool operator()(const Item &item) const {
 		assert(defined());
 		return m_filter(m_rx, item.value());
@@ -160,6 +257,7 @@ struct Filter
 private:
 	Regex m_rx;
 	std::string m_constraint;
+	boost::regex_constants::syntax_option_type m_flags;
 	FilterFunction m_filter;
 };
 
@@ -177,6 +275,7 @@ template <typename T> struct ItemFilter
 	           FilterT &&filter)
 		: m_rx(make(constraint_, flags))
 		, m_constraint(constraint_)
+		, m_flags(flags)
 		, m_filter(std::forward<FilterT>(filter))
 	{ }
 	
@@ -189,6 +288,10 @@ template <typename T> struct ItemFilter
 		return m_constraint;
 	}
 
+	boost::regex_constants::syntax_option_type flags() const {
+		return m_flags;
+	}
+
 	bool operator()(const Item &item) {
 		return m_filter(m_rx, item);
 	}
@@ -201,9 +304,61 @@ template <typename T> struct ItemFilter
 private:
 	Regex m_rx;
 	std::string m_constraint;
+	boost::regex_constants::syntax_option_type m_flags;
 	FilterFunction m_filter;
 };
 
+// Whether everything matched by new_constraint is also matched by
+// old_constraint. It's conservative, i.e. it may return false even if that's
+// the case.
+inline bool narrows(const std::string &old_constraint,
+                    const std::string &new_constraint,
+                    boost::regex_constants::syntax_option_type flags)
+{
+	if (new_constraint.size() <= old_constraint.size()
+	    || new_constraint.compare(0, old_constraint.size(), old_constraint) != 0)
+		return false;
+	if (flags & boost::regex_constants::literal)
+		return true;
+	// Without special characters both are searches for a substring.
+	return new_constraint.find_first_of("\\^$.|?*+()[]{}") == std::string::npos;
+}
+
+// Apply filter to the menu reusing results of the current one if possible. If
+// the new constraint narrows the current one, only items that are currently
+// shown are checked. If it's one of the constraints the current one was
+// refined from (e.g. when characters are deleted from the end), its results
+// are restored.
+template <typename ItemT, typename FilterT>
+void applyFilter(NC::Menu<ItemT> &menu, FilterT &&filter)
+{
+	typedef typename std::decay<FilterT>::type FilterType;
+	bool reverted = false;
+	while (auto current = menu.template filterPredicate<FilterType>())
+	{
+		if (current->flags() != filter.flags())
+			break;
+		// Reapplying the current filter is meant to take changes of the items
+		// into account, so its results can't be reused.
+		if (current->constraint() == filter.constraint())
+		{
+			if (reverted)
+				return;
+			else
+				break;
+		}
+		if (narrows(current->constraint(), filter.constraint(), filter.flags()))
+		{
+			menu.refineFilter(std::forward<FilterT>(filter));
+			return;
+		}
+		if (!menu.revertFilter())
+			break;
+		reverted = true;
+	}
+	menu.applyFilter(std::forward<FilterT>(filter));
+}
+
 }
 
 #endif // NCMPCPP_REGEX_FILTER_H
@@ -22,6 +22,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/locale/conversion.hpp>
+#include <numeric>
 #include <time.h>
 
 #include "screens/browser.h"
@@ -33,6 +34,7 @@
 #include "curses/menu_impl.h"
 #include "screens/screen_switcher.h"
 #include "settings.h"
+#include "song_store.h"
 #include "status.h"
 #include "statusbar.h"
 #include "screens/tag_editor.h"
@@ -121,6 +123,16 @@ ConstSongIterator BrowserWindow::endS() const
 	return makeConstSongIterator(end());
 }
 
+const MPD::Song *BrowserWindow::songAt(size_t pos) const
+{
+	return menuSongAt(*this, pos);
+}
+
+const MPD::Song *BrowserWindow::currentSong() const
+{
+	return menuCurrentSong(*this);
+}
+
 std::vector<MPD::Song> BrowserWindow::getSelectedSongs()
 {
 	return {}; // TODO
@@ -284,10 +296,10 @@ void Browser::applyFilter(const std::string &constraint)
 {
 	if (!constraint.empty())
 	{
-		w.applyFilter(Regex::Filter<MPD::Item>(
-			              constraint,
-			              Config.regex_type,
-			              std::bind(browserEntryMatcher, ph::_1, ph::_2, true)));
+		Regex::applyFilter(w, Regex::Filter<MPD::Item>(
+			                     constraint,
+			                     Config.regex_type,
+			                     std::bind(browserEntryMatcher, ph::_1, ph::_2, true)));
 	}
 	else
 		w.clearFilter();
@@ -698,9 +710,19 @@ void getLocalDirectoryRecursively(std::vector<MPD::Song> &songs, const std::stri
 
 	if (Config.browser_sort_mode != SortMode::None)
 	{
-		std::stable_sort(songs.begin()+sort_offset, songs.end(),
-		                 LocaleBasedSorting(std::locale(), Config.ignore_leading_the)
-		);
+		// Names are interned and ranked once, so that sorting doesn't need to
+		// create them for every comparison.
+		MPD::SongStore store({ &MPD::Song::getName });
+		for (auto it = songs.begin()+sort_offset; it != songs.end(); ++it)
+			store.add(*it);
+		auto ranks = store.strings().ranks(
+			LocaleStringComparison(std::locale(), Config.ignore_leading_the));
+		std::vector<size_t> order(store.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return ranks[store.id(a, 0)] < ranks[store.id(b, 0)];
+		});
+		MPD::reorder(songs.begin()+sort_offset, order);
 	}
 }
 
@@ -40,6 +40,9 @@ struct BrowserWindow: NC::Menu<MPD::Item>, SongList
 	virtual SongIterator endS() override;
 	virtual ConstSongIterator endS() const override;
 
+	virtual const MPD::Song *songAt(size_t pos) const override;
+	virtual const MPD::Song *currentSong() const override;
+
 	virtual std::vector<MPD::Song> getSelectedSongs() override;
 };
 
@@ -25,6 +25,9 @@
 #include <cerrno>
 #include <cstring>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
 #include <thread>
 
 #include "curses/scrollpad.h"
@@ -34,6 +37,7 @@
 #include "format_impl.h"
 #include "global.h"
 #include "helpers.h"
+#include "lyrics_store.h"
 #include "macro_utilities.h"
 #include "screens/lyrics.h"
 #include "screens/playlist.h"
@@ -59,10 +63,27 @@ std::string removeExtension(std::string filename)
 	return filename;
 }
 
+// Lyrics are kept in files next to songs if store_lyrics_in_song_dir is set,
+// otherwise in the lyrics store.
+bool lyricsInSongDir(const MPD::Song &s)
+{
+	return Config.store_lyrics_in_song_dir && !s.isStream();
+}
+
+std::string lyricsName(const MPD::Song &s)
+{
+	std::string artist = s.getArtist();
+	std::string title  = s.getTitle();
+	if (artist.empty() || title.empty())
+		return removeExtension(s.getName());
+	else
+		return artist + " - " + title;
+}
+
 std::string lyricsFilename(const MPD::Song &s)
 {
 	std::string filename;
-	if (Config.store_lyrics_in_song_dir && !s.isStream())
+	if (lyricsInSongDir(s))
 	{
 		if (s.isFromDatabase())
 			filename = Config.mpd_music_dir + "/";
@@ -71,12 +92,7 @@ std::string lyricsFilename(const MPD::Song &s)
 	}
 	else
 	{
-		std::string artist = s.getArtist();
-		std::string title  = s.getTitle();
-		if (artist.empty() || title.empty())
-			filename = removeExtension(s.getName());
-		else
-			filename = artist + " - " + title;
+		filename = lyricsName(s);
 		removeInvalidCharsFromFilename(filename, Config.generate_win32_compatible_filenames);
 		filename = Config.lyrics_directory + "/" + filename;
 	}
@@ -84,29 +100,44 @@ std::string lyricsFilename(const MPD::Song &s)
 	return filename;
 }
 
-bool loadLyrics(NC::Scrollpad &w, const std::string &filename)
+std::string lyricsKey(const MPD::Song &s)
+{
+	return LyricsStore::key(lyricsName(s));
+}
+
+bool hasLyrics(const MPD::Song &s)
 {
-	std::ifstream input(filename);
-	if (input.is_open())
+	if (lyricsInSongDir(s))
+		return boost::filesystem::exists(lyricsFilename(s));
+	else
 	{
-		std::string line;
-		bool first_line = true;
-		while (std::getline(input, line))
-		{
-			// Remove carriage returns as they mess up the display.
-			boost::remove_erase(line, '\r');
-			if (!first_line)
-				w << '\n';
-			w << Charset::utf8ToLocale(line);
-			first_line = false;
-		}
-		return true;
+		std::string key = lyricsKey(s);
+		LyricsStore::importExported(key);
+		return LyricsStore::contains(key);
+	}
+}
+
+boost::optional<std::string> loadLyrics(const MPD::Song &s)
+{
+	boost::optional<std::string> result;
+	if (lyricsInSongDir(s))
+	{
+		std::ifstream input(lyricsFilename(s), std::ios::binary);
+		if (input.is_open())
+			result = std::string(std::istreambuf_iterator<char>(input),
+			                     std::istreambuf_iterator<char>());
 	}
 	else
-		return false;
+	{
+		std::string key = lyricsKey(s);
+		if (!LyricsStore::importExported(key))
+			Statusbar::printf("Couldn't import lyrics from \"%1%\"", lyricsFilename(s));
+		result = LyricsStore::get(key);
+	}
+	return result;
 }
 
-bool saveLyrics(const std::string &filename, const std::string &lyrics)
+bool saveLyricsToFile(const std::string &filename, const std::string &lyrics)
 {
 	std::ofstream output(filename);
 	if (output.is_open())
@@ -119,6 +150,41 @@ bool saveLyrics(const std::string &filename, const std::string &lyrics)
 		return false;
 }
 
+bool saveLyrics(const MPD::Song &s, const std::string &lyrics)
+{
+	if (lyricsInSongDir(s))
+		return saveLyricsToFile(lyricsFilename(s), lyrics);
+	else
+		return LyricsStore::put(lyricsKey(s), lyrics);
+}
+
+bool removeLyrics(const MPD::Song &s)
+{
+	if (lyricsInSongDir(s))
+	{
+		std::string filename = lyricsFilename(s);
+		return std::remove(filename.c_str()) == 0 || errno == ENOENT;
+	}
+	else
+		return LyricsStore::remove(lyricsKey(s));
+}
+
+void showLyrics(NC::Scrollpad &w, const std::string &lyrics)
+{
+	std::istringstream input(lyrics);
+	std::string line;
+	bool first_line = true;
+	while (std::getline(input, line))
+	{
+		// Remove carriage returns as they mess up the display.
+		boost::remove_erase(line, '\r');
+		if (!first_line)
+			w << '\n';
+		w << Charset::utf8ToLocale(line);
+		first_line = false;
+	}
+}
+
 boost::optional<std::string> downloadLyrics(
 	const MPD::Song &s,
 	std::shared_ptr<Shared<NC::Buffer>> shared_buffer,
@@ -166,8 +232,66 @@ boost::optional<std::string> downloadLyrics(
 		return result_;
 	};
 
+	// Query all fetchers at once and take the first result in their order that
+	// was found, aborting the rest.
+	auto fetch_lyrics_concurrently = [&] {
+		if (shared_buffer)
+		{
+			auto buf = shared_buffer->acquire();
+			*buf << "Fetching lyrics from all sources...\n";
+		}
+
+		const auto &fetchers = Config.lyrics_fetchers;
+		std::vector<LyricsFetcher::Session> sessions;
+		for (auto &fetcher : fetchers)
+			sessions.push_back(fetcher->start(s_artist, s_title));
+
+		Curl::Multi multi;
+		std::function<void(size_t)> perform = [&](size_t i) {
+			multi.add([&, i](CURLcode code, std::string &data) {
+				auto &session = sessions[i];
+				fetchers[i]->process(session, code, data);
+				if (!session.done)
+					perform(i);
+				else if (!session.result.first && shared_buffer)
+				{
+					auto buf = shared_buffer->acquire();
+					*buf << NC::Format::Bold << fetchers[i]->name() << NC::Format::NoBold
+					     << ": "
+					     << NC::Color::Red << session.result.second << NC::Color::End
+					     << '\n';
+				}
+			}, sessions[i].url, sessions[i].referer, sessions[i].follow_redirect);
+		};
+		for (size_t i = 0; i < sessions.size(); ++i)
+			perform(i);
+
+		// Index of the first session that isn't known to have failed.
+		auto first_pending = [&sessions] {
+			size_t i = 0;
+			while (i < sessions.size() && sessions[i].done && !sessions[i].result.first)
+				++i;
+			return i;
+		};
+		multi.run([&] {
+			if (download_stopper && download_stopper->load())
+				return true;
+			size_t i = first_pending();
+			return i == sessions.size() || sessions[i].done;
+		});
+
+		LyricsFetcher::Result result_;
+		result_.first = false;
+		size_t i = first_pending();
+		if (i < sessions.size() && sessions[i].done)
+			result_ = std::move(sessions[i].result);
+		return result_;
+	};
+
 	LyricsFetcher::Result fetcher_result;
-	if (current_fetcher == nullptr)
+	if (current_fetcher == nullptr && Config.fetch_lyrics_concurrently)
+		fetcher_result = fetch_lyrics_concurrently();
+	else if (current_fetcher == nullptr)
 	{
 		for (auto &fetcher : Config.lyrics_fetchers)
 		{
@@ -224,10 +348,8 @@ void Lyrics::update()
 			{
 				w.clear();
 				w << Charset::utf8ToLocale(*lyrics);
-				std::string filename = lyricsFilename(m_song);
-				if (!saveLyrics(filename, *lyrics))
-					Statusbar::printf("Couldn't save lyrics as \"%1%\": %2%",
-					                  filename, strerror(errno));
+				if (!saveLyrics(m_song, *lyrics))
+					Statusbar::printf("Couldn't save lyrics: %1%", strerror(errno));
 			}
 			else
 				w << "\nLyrics were not found.\n";
@@ -281,8 +403,10 @@ void Lyrics::fetch(const MPD::Song &s)
 		w.clear();
 		w.reset();
 		m_song = s;
-		if (loadLyrics(w, lyricsFilename(m_song)))
+		auto lyrics = loadLyrics(m_song);
+		if (lyrics)
 		{
+			showLyrics(w, *lyrics);
 			clearWorker();
 			m_refresh_window = true;
 		}
@@ -300,13 +424,8 @@ void Lyrics::fetch(const MPD::Song &s)
 
 void Lyrics::refetchCurrent()
 {
-	std::string filename = lyricsFilename(m_song);
-	if (std::remove(filename.c_str()) == -1 && errno != ENOENT)
-	{
-		const char msg[] = "Couldn't remove \"%1%\": %2%";
-		Statusbar::printf(msg, wideShorten(filename, COLS - const_strlen(msg) - 25),
-		                  strerror(errno));
-	}
+	if (!removeLyrics(m_song))
+		Statusbar::printf("Couldn't remove lyrics: %1%", strerror(errno));
 	else
 	{
 		clearWorker();
@@ -325,6 +444,19 @@ void Lyrics::edit()
 	Statusbar::print("Opening lyrics in external editor...");
 
 	std::string filename = lyricsFilename(m_song);
+	if (!lyricsInSongDir(m_song))
+	{
+		// Lyrics from the store are edited as a file and imported back when
+		// they're looked up after the file was modified.
+		auto lyrics = loadLyrics(m_song);
+		if (lyrics && !saveLyricsToFile(filename, *lyrics))
+		{
+			Statusbar::printf("Couldn't save lyrics as \"%1%\": %2%",
+			                  filename, strerror(errno));
+			return;
+		}
+		LyricsStore::exportedTo(lyricsKey(m_song), filename);
+	}
 	escapeSingleQuotes(filename);
 	if (Config.use_console_editor)
 	{
@@ -364,7 +496,6 @@ void Lyrics::toggleFetcher()
 void Lyrics::fetchInBackground(const MPD::Song &s, bool notify_)
 {
 	auto consumer_impl = [this] {
-		std::string lyrics_file;
 		while (true)
 		{
 			ConsumerState::Song cs;
@@ -376,8 +507,7 @@ void Lyrics::fetchInBackground(const MPD::Song &s, bool notify_)
 					consumer->running = false;
 					break;
 				}
-				lyrics_file = lyricsFilename(consumer->songs.front().song());
-				if (!boost::filesystem::exists(lyrics_file))
+				if (!hasLyrics(consumer->songs.front().song()))
 				{
 					cs = consumer->songs.front();
 					if (cs.notify())
@@ -393,7 +523,7 @@ void Lyrics::fetchInBackground(const MPD::Song &s, bool notify_)
 			{
 				auto lyrics = downloadLyrics(cs.song(), nullptr, nullptr, m_fetcher);
 				if (lyrics)
-					saveLyrics(lyrics_file, *lyrics);
+					saveLyrics(cs.song(), *lyrics);
 			}
 		}
 	};
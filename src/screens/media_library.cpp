@@ -23,13 +23,16 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <numeric>
 
 #include "charset.h"
+#include "database_cache.h"
 #include "display.h"
 #include "helpers.h"
 #include "global.h"
 #include "curses/menu_impl.h"
 #include "mpdpp.h"
+#include "song_store.h"
 #include "screens/playlist.h"
 #include "screens/media_library.h"
 #include "status.h"
@@ -62,6 +65,7 @@ size_t itsRightColWidth;
 size_t itsRightColStartX;
 
 typedef MediaLibrary::PrimaryTag PrimaryTag;
+typedef MediaLibrary::Album Album;
 typedef MediaLibrary::AlbumEntry AlbumEntry;
 
 std::string Date_(std::string date)
@@ -95,49 +99,76 @@ bool SongEntryMatcher(const Regex::Regex &rx, const MPD::Song &s);
 bool MoveToTag(NC::Menu<PrimaryTag> &tags, const std::string &primary_tag);
 bool MoveToAlbum(NC::Menu<AlbumEntry> &albums, const std::string &primary_tag, const MPD::Song &s, bool consider_date);
 
-struct SortSongs {
-	typedef NC::Menu<MPD::Song>::Item SongItem;
-	
-	static const std::array<MPD::Song::GetFunction, 3> GetFuns;
-	
-	LocaleStringComparison m_cmp;
+const MPD::Song &songOf(const MPD::Song &s)
+{
+	return s;
+}
 
-public:
-	SortSongs()
-	: m_cmp(std::locale(), Config.ignore_leading_the) { }
-	
-	bool operator()(const SongItem &a, const SongItem &b) {
-		return (*this)(a.value(), b.value());
+const MPD::Song &songOf(const NC::Menu<MPD::Song>::Item &item)
+{
+	return item.value();
+}
+
+// Sort songs by date, album, disc, track number and display format. Tags of
+// all songs are interned and ranked up front, so that comparing two songs
+// boils down to comparing integers.
+template <typename IteratorT>
+void sortSongs(IteratorT first, IteratorT last)
+{
+	enum Field { Date, Album, Disc, Track };
+	MPD::SongStore store({
+		&MPD::Song::getDate,
+		&MPD::Song::getAlbum,
+		&MPD::Song::getDisc,
+		&MPD::Song::getTrackNumber
+	});
+	for (auto it = first; it != last; ++it)
+		store.add(songOf(*it));
+	auto ranks = store.strings().ranks(
+		LocaleStringComparison(std::locale(), Config.ignore_leading_the));
+
+	std::vector<boost::optional<int>> tracks(store.size());
+	for (size_t i = 0; i < store.size(); ++i)
+	{
+		int track;
+		if (boost::conversion::try_lexical_convert(store.get(i, Track), track))
+			tracks[i] = track;
 	}
-	bool operator()(const MPD::Song &a, const MPD::Song &b) {
-		int ret;
-		for (auto get : GetFuns) {
-			ret = m_cmp(a.getTags(get), b.getTags(get));
-			if (ret != 0)
-				return ret < 0;
+
+	// Display format is used only if everything else is equal, so compute it
+	// on demand.
+	std::vector<boost::optional<std::string>> formats(store.size());
+	auto format = [&](size_t i) -> const std::string & {
+		if (!formats[i])
+			formats[i] = Format::stringify<char>(
+				Config.song_library_format, &songOf(first[i]));
+		return *formats[i];
+	};
+
+	std::vector<size_t> order(store.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		for (auto field : { Date, Album, Disc })
+		{
+			auto ra = ranks[store.id(a, field)], rb = ranks[store.id(b, field)];
+			if (ra != rb)
+				return ra < rb;
 		}
 
 		// Sort by track numbers.
-		try {
-			ret = boost::lexical_cast<int>(a.getTags(&MPD::Song::getTrackNumber))
-			    - boost::lexical_cast<int>(b.getTags(&MPD::Song::getTrackNumber));
-		} catch (boost::bad_lexical_cast &) {
-			ret = a.getTrackNumber().compare(b.getTrackNumber());
-		}
+		int ret;
+		if (tracks[a] && tracks[b])
+			ret = *tracks[a] - *tracks[b];
+		else
+			ret = store.get(a, Track).compare(store.get(b, Track));
 		if (ret != 0)
 			return ret < 0;
 
 		// If track numbers are equal, sort by the display format.
-		return Format::stringify<char>(Config.song_library_format, &a)
-		     < Format::stringify<char>(Config.song_library_format, &b);
-	}
-};
-
-const std::array<MPD::Song::GetFunction, 3> SortSongs::GetFuns = {{
-	&MPD::Song::getDate,
-	&MPD::Song::getAlbum,
-	&MPD::Song::getDisc
-}};
+		return format(a) < format(b);
+	});
+	MPD::reorder(first, order);
+}
 
 class SortAlbumEntries {
 	typedef MediaLibrary::Album Album;
@@ -182,12 +213,142 @@ public:
 	}
 };
 
+typedef std::map<std::string, time_t> TagMap;
+typedef std::map<std::tuple<std::string, std::string, std::string>, time_t> AlbumMap;
+
+void setTags(NC::Menu<PrimaryTag> &menu, NC::Menu<AlbumEntry> &albums, const TagMap &tags)
+{
+	std::string current_tag;
+	if (!menu.empty())
+		current_tag = menu.current()->value().tag();
+	size_t idx = 0;
+	for (const auto &tag : tags)
+	{
+		auto ptag = PrimaryTag(tag.first, tag.second);
+		if (idx < menu.size())
+			menu[idx].value() = std::move(ptag);
+		else
+			menu.addItem(std::move(ptag));
+		++idx;
+	}
+	if (idx < menu.size())
+		menu.resizeList(idx);
+	std::sort(menu.beginV(), menu.endV(), SortPrimaryTags());
+	// If the list is rebuilt incrementally, the highlighted tag may change, in
+	// which case the list of albums no longer corresponds to it.
+	if (menu.empty() || menu.current()->value().tag() != current_tag)
+		albums.clear();
+}
+
+void setAlbums(NC::Menu<AlbumEntry> &menu, SongMenu &songs, const AlbumMap &albums)
+{
+	auto albumKey = [](const AlbumEntry &ae) {
+		return std::make_tuple(ae.entry().tag(), ae.entry().album(), ae.entry().date());
+	};
+	AlbumMap::key_type current_album;
+	if (!menu.empty())
+		current_album = albumKey(menu.current()->value());
+	size_t idx = 0;
+	for (const auto &album : albums)
+	{
+		auto entry = AlbumEntry(
+			Album(std::get<0>(album.first),
+			      std::get<1>(album.first),
+			      std::get<2>(album.first),
+			      album.second));
+		if (idx < menu.size())
+			menu[idx].value() = std::move(entry);
+		else
+			menu.addItem(std::move(entry));
+		++idx;
+	}
+	if (idx < menu.size())
+		menu.resizeList(idx);
+	std::sort(menu.beginV(), menu.endV(), SortAlbumEntries());
+	// Same as above, but for songs.
+	if (menu.empty() || albumKey(menu.current()->value()) != current_album)
+		songs.clear();
 }
 
+}
+
+struct MediaLibrary::DatabaseScan
+{
+	DatabaseScan()
+	: m_songs_processed(0)
+	, m_songs_total(0)
+	, m_waiting_for_cache(false)
+	{
+		if (Config.media_library_incremental_update)
+		{
+			// Get the number of songs before starting to iterate over the
+			// database as it might occupy the connection.
+			m_songs_total = Mpd.getStatistics().songs();
+			// If the database cache is outdated, rebuild it using the worker
+			// connection and read songs from it once it's done.
+			m_waiting_for_cache = DatabaseCache::refreshInBackground();
+		}
+		if (m_waiting_for_cache)
+			Statusbar::print("Fetching database...");
+		else
+			m_song = DatabaseCache::songs();
+	}
+
+	bool waitingForCache() const
+	{
+		return m_waiting_for_cache;
+	}
+
+	// Process the next chunk of songs. Returns true if all of them were
+	// processed. Songs streamed from MPD are always processed all at once as
+	// the iterator occupies the connection.
+	template <typename ProcessSongT>
+	bool process(ProcessSongT process_song)
+	{
+		if (m_waiting_for_cache)
+		{
+			if (DatabaseCache::refreshing())
+				return false;
+			// The database might have changed in the meantime.
+			if (DatabaseCache::refreshInBackground())
+				return false;
+			m_waiting_for_cache = false;
+			m_song = DatabaseCache::songs();
+		}
+
+		const size_t chunk_size = 5000;
+		DatabaseCache::SongIterator end;
+		for (size_t i = 0; m_song != end; ++m_song, ++i)
+		{
+			if (Config.media_library_incremental_update
+			    && i == chunk_size
+			    && m_song.isLocal())
+			{
+				m_songs_processed += i;
+				Statusbar::printf("Loading media library: %1%%%",
+					m_songs_total > 0 ? std::min(m_songs_processed * 100 / m_songs_total, size_t(99)) : 0);
+				return false;
+			}
+			process_song(*m_song);
+		}
+		return true;
+	}
+
+	TagMap tags;
+	AlbumMap albums;
+
+private:
+	DatabaseCache::SongIterator m_song;
+	size_t m_songs_processed;
+	size_t m_songs_total;
+	bool m_waiting_for_cache;
+};
+
 MediaLibrary::MediaLibrary()
 : m_timer(boost::posix_time::from_time_t(0))
 , m_window_timeout(Config.data_fetching_delay ? 250 : BaseScreen::defaultWindowTimeout)
 , m_fetching_delay(boost::posix_time::milliseconds(Config.data_fetching_delay ? 250 : -1))
+, m_tags_fetching(false)
 {
 	hasTwoColumns = 0;
 	isAlbumOnly = 0;
@@ -309,15 +470,12 @@ void MediaLibrary::update()
 	if (hasTwoColumns)
 	{
 		ScopedUnfilteredMenu<AlbumEntry> sunfilter_albums(ReapplyFilter::No, Albums);
-		if (Albums.empty() || m_albums_update_request)
+		if (m_albums_update_request || (Albums.empty() && m_database_scan == nullptr))
 		{
 			m_albums_update_request = false;
-			sunfilter_albums.set(ReapplyFilter::Yes, true);
-			std::map<std::tuple<std::string, std::string, std::string>, time_t> albums;
-			MPD::SongIterator s, end;
 			try
 			{
-				s = Mpd.GetDirectoryRecursive("/");
+				m_database_scan = std::make_shared<DatabaseScan>();
 			}
 			catch (MPD::Error &e)
 			{
@@ -325,57 +483,48 @@ void MediaLibrary::update()
 				toggleColumnsMode();
 				throw;
 			}
-			for (; s != end; ++s)
-			{
+		}
+		if (m_database_scan != nullptr)
+		{
+			sunfilter_albums.set(ReapplyFilter::Yes, true);
+			auto &albums = m_database_scan->albums;
+			bool finished = m_database_scan->process([&albums](const MPD::Song &s) {
 				std::string tag;
 				unsigned idx = 0;
-				while (!(tag = s->get(Config.media_lib_primary_tag, idx++)).empty())
+				while (!(tag = s.get(Config.media_lib_primary_tag, idx++)).empty())
 				{
 					auto key = std::make_tuple(
 						isAlbumOnly ? "" : std::move(tag),
-						s->getAlbum(),
-						Date_(s->getDate()));
+						s.getAlbum(),
+						Date_(s.getDate()));
 					auto it = albums.find(key);
 					if (it == albums.end())
-						albums[std::move(key)] = s->getMTime();
+						albums[std::move(key)] = s.getMTime();
 					else
-						it->second = s->getMTime();
+						it->second = s.getMTime();
 				}
-			}
-			size_t idx = 0;
-			for (const auto &album : albums)
-			{
-				auto entry = AlbumEntry(
-					Album(std::move(std::get<0>(album.first)),
-					      std::move(std::get<1>(album.first)),
-					      std::move(std::get<2>(album.first)),
-					      album.second));
-				if (idx < Albums.size())
-					Albums[idx].value() = std::move(entry);
-				else
-					Albums.addItem(std::move(entry));
-				++idx;
-			}
-			if (idx < Albums.size())
-				Albums.resizeList(idx);
-			std::sort(Albums.beginV(), Albums.endV(), SortAlbumEntries());
+			});
+			setAlbums(Albums, Songs, albums);
+			if (finished)
+				m_database_scan = nullptr;
+			else if (isVisible(this))
+				Albums.refresh();
 		}
 	}
 	else
 	{
 		{
 			ScopedUnfilteredMenu<PrimaryTag> sunfilter_tags(ReapplyFilter::No, Tags);
-			if (Tags.empty() || m_tags_update_request)
+			if ((m_tags_update_request || (Tags.empty() && m_database_scan == nullptr))
+			    && !m_tags_fetching)
 			{
 				m_tags_update_request = false;
 				sunfilter_tags.set(ReapplyFilter::Yes, true);
-				std::map<std::string, time_t> tags;
 				if (Config.media_library_sort_by_mtime)
 				{
-					MPD::SongIterator s, end;
 					try
 					{
-						s = Mpd.GetDirectoryRecursive("/");
+						m_database_scan = std::make_shared<DatabaseScan>();
 					}
 					catch (MPD::Error &e)
 					{
@@ -383,39 +532,54 @@ void MediaLibrary::update()
 						toggleSortMode();
 						throw;
 					}
-					for (; s != end; ++s)
-					{
-						std::string tag;
-						unsigned idx = 0;
-						while (!(tag = s->get(Config.media_lib_primary_tag, idx++)).empty())
-						{
-							auto it = tags.find(tag);
-							if (it == tags.end())
-								tags[std::move(tag)] = s->getMTime();
-							else
-								it->second = std::max(it->second, s->getMTime());
-						}
-					}
 				}
 				else
 				{
-					MPD::StringIterator tag = Mpd.GetList(Config.media_lib_primary_tag), end;
-					for (; tag != end; ++tag)
-						tags[std::move(*tag)] = 0;
-				}
-				size_t idx = 0;
-				for (const auto &tag : tags)
-				{
-					auto ptag = PrimaryTag(std::move(tag.first), tag.second);
-					if (idx < Tags.size())
-						Tags[idx].value() = std::move(ptag);
-					else
-						Tags.addItem(std::move(ptag));
-					++idx;
+					m_database_scan = nullptr;
+					// Listing tags of a large database may take a while, so it's done
+					// on the worker connection to keep the interface responsive.
+					m_tags_fetching = true;
+					MpdWorker.submit(
+						[tag_type = Config.media_lib_primary_tag](MPD::Connection &c) {
+							TagMap tags;
+							MPD::StringIterator tag = c.GetList(tag_type), end;
+							for (; tag != end; ++tag)
+								tags[std::move(*tag)] = 0;
+							return tags;
+						},
+						[this](const TagMap &tags) {
+							m_tags_fetching = false;
+							ScopedUnfilteredMenu<PrimaryTag> sunfilter_tags(ReapplyFilter::Yes, Tags);
+							setTags(Tags, Albums, tags);
+							if (isVisible(this))
+								Tags.refresh();
+						},
+						[this] {
+							m_tags_fetching = false;
+						});
 				}
-				if (idx < Tags.size())
-					Tags.resizeList(idx);
-				std::sort(Tags.beginV(), Tags.endV(), SortPrimaryTags());
+			}
+			if (m_database_scan != nullptr)
+			{
+				sunfilter_tags.set(ReapplyFilter::Yes, true);
+				auto &tags = m_database_scan->tags;
+				bool finished = m_database_scan->process([&tags](const MPD::Song &s) {
+					std::string tag;
+					unsigned idx = 0;
+					while (!(tag = s.get(Config.media_lib_primary_tag, idx++)).empty())
+					{
+						auto it = tags.find(tag);
+						if (it == tags.end())
+							tags[std::move(tag)] = s.getMTime();
+						else
+							it->second = std::max(it->second, s.getMTime());
+					}
+				});
+				setTags(Tags, Albums, tags);
+				if (finished)
+					m_database_scan = nullptr;
+				else if (isVisible(this))
+					Tags.refresh();
 			}
 		}
 
@@ -488,12 +652,15 @@ void MediaLibrary::update()
 		};
 		if (idx < Songs.size())
 			Songs.resizeList(idx);
-		std::sort(Songs.begin(), Songs.end(), SortSongs());
+		sortSongs(Songs.begin(), Songs.end());
 	}
 }
 
 int MediaLibrary::windowTimeout()
 {
+	// Don't wait for input if there are more songs to process.
+	if (m_database_scan != nullptr && !m_database_scan->waitingForCache())
+		return 0;
 	ScopedUnfilteredMenu<AlbumEntry> sunfilter_albums(ReapplyFilter::No, Albums);
 	ScopedUnfilteredMenu<MPD::Song> sunfilter_songs(ReapplyFilter::No, Songs);
 	if (Albums.empty() || Songs.empty())
@@ -677,10 +844,10 @@ void MediaLibrary::applyFilter(const std::string &constraint)
 	{
 		if (!constraint.empty())
 		{
-			Tags.applyFilter(Regex::Filter<PrimaryTag>(
-				                 constraint,
-				                 Config.regex_type,
-				                 TagEntryMatcher));
+			Regex::applyFilter(Tags, Regex::Filter<PrimaryTag>(
+				                        constraint,
+				                        Config.regex_type,
+				                        TagEntryMatcher));
 		}
 		else
 			Tags.clearFilter();
@@ -689,10 +856,10 @@ void MediaLibrary::applyFilter(const std::string &constraint)
 	{
 		if (!constraint.empty())
 		{
-			Albums.applyFilter(Regex::ItemFilter<AlbumEntry>(
-				                   constraint,
-				                   Config.regex_type,
-				                   std::bind(AlbumEntryMatcher, ph::_1, ph::_2, true)));
+			Regex::applyFilter(Albums, Regex::ItemFilter<AlbumEntry>(
+				                          constraint,
+				                          Config.regex_type,
+				                          std::bind(AlbumEntryMatcher, ph::_1, ph::_2, true)));
 		}
 		else
 			Albums.clearFilter();
@@ -701,10 +868,10 @@ void MediaLibrary::applyFilter(const std::string &constraint)
 	{
 		if (!constraint.empty())
 		{
-			Songs.applyFilter(Regex::Filter<MPD::Song>(
-				                  constraint,
-				                  Config.regex_type,
-				                  SongEntryMatcher));
+			Regex::applyFilter(Songs, Regex::Filter<MPD::Song>(
+				                         constraint,
+				                         Config.regex_type,
+				                         SongEntryMatcher));
 		}
 		else
 			Songs.clearFilter();
@@ -740,7 +907,7 @@ bool MediaLibrary::addItemToPlaylist(bool play)
 			std::vector<MPD::Song> list(
 				std::make_move_iterator(Mpd.CommitSearchSongs()),
 				std::make_move_iterator(MPD::SongIterator()));
-			std::sort(list.begin(), list.end(), SortSongs());
+			sortSongs(list.begin(), list.end());
 			result = addSongsToPlaylist(list.begin(), list.end(), play, -1);
 			std::string tag_type = boost::locale::to_lower(
 				tagTypeToString(Config.media_lib_primary_tag));
@@ -752,7 +919,7 @@ bool MediaLibrary::addItemToPlaylist(bool play)
 			std::vector<MPD::Song> list(
 				std::make_move_iterator(getSongsFromAlbum(Albums.current()->value())),
 				std::make_move_iterator(MPD::SongIterator()));
-			std::sort(list.begin(), list.end(), SortSongs());
+			sortSongs(list.begin(), list.end());
 			result = addSongsToPlaylist(list.begin(), list.end(), play, -1);
 			Statusbar::printf("Songs from album \"%1%\" added%2%",
 				Albums.current()->value().entry().album(), withErrors(result));
@@ -774,7 +941,7 @@ std::vector<MPD::Song> MediaLibrary::getSelectedSongs()
 				std::make_move_iterator(Mpd.CommitSearchSongs()),
 				std::make_move_iterator(MPD::SongIterator()),
 				std::back_inserter(result));
-			std::sort(result.begin()+begin, result.end(), SortSongs());
+			sortSongs(result.begin()+begin, result.end());
 		};
 		bool any_selected = false;
 		for (auto &e : Tags)
@@ -812,7 +979,7 @@ std::vector<MPD::Song> MediaLibrary::getSelectedSongs()
 					std::make_move_iterator(Mpd.CommitSearchSongs()),
 					std::make_move_iterator(MPD::SongIterator()),
 					std::back_inserter(result));
-				std::sort(result.begin()+begin, result.end(), SortSongs());
+				sortSongs(result.begin()+begin, result.end());
 			}
 		}
 		// if no item is selected, add songs from right column
@@ -825,7 +992,7 @@ std::vector<MPD::Song> MediaLibrary::getSelectedSongs()
 				std::make_move_iterator(MPD::SongIterator()),
 				std::back_inserter(result)
 			);
-			std::sort(result.begin()+begin, result.end(), SortSongs());
+			sortSongs(result.begin()+begin, result.end());
 		}
 	}
 	else if (isActiveWindow(Songs))
@@ -926,6 +1093,7 @@ void MediaLibrary::toggleColumnsMode()
 	else
 		hasTwoColumns = 1;
 
+	m_database_scan = nullptr;
 	Tags.clear();
 	Albums.clear();
 	Albums.reset();
@@ -1001,6 +1169,7 @@ void MediaLibrary::toggleSortMode()
 		}
 		else
 		{
+			m_database_scan = nullptr;
 			Tags.clear();
 		}
 		Albums.clear();
@@ -22,6 +22,7 @@
 #define NCMPCPP_MEDIA_LIBRARY_H
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <memory>
 
 #include "interfaces.h"
 #include "regex_filter.h"
@@ -139,6 +140,8 @@ struct MediaLibrary: Screen<NC::Window *>, Filterable, HasColumns, HasSongs, Sea
 	SongMenu Songs;
 	
 private:
+	struct DatabaseScan;
+
 	bool m_tags_update_request;
 	bool m_albums_update_request;
 	bool m_songs_update_request;
@@ -148,6 +151,10 @@ private:
 	const int m_window_timeout;
 	const boost::posix_time::time_duration m_fetching_delay;
 
+	std::shared_ptr<DatabaseScan> m_database_scan;
+	// Whether tags are being listed by the worker connection.
+	bool m_tags_fetching;
+
 	Regex::Filter<PrimaryTag> m_tags_search_predicate;
 	Regex::ItemFilter<AlbumEntry> m_albums_search_predicate;
 	Regex::Filter<MPD::Song> m_songs_search_predicate;
@@ -44,6 +44,35 @@ namespace ph = std::placeholders;
 
 Playlist *myPlaylist;
 
+void Playlist::setSong(size_t pos, MPD::Song s)
+{
+	registerSong(s);
+	if (pos < w.size())
+	{
+		// if song's already in playlist, replace it with a new one
+		MPD::Song &old_s = w[pos].value();
+		unregisterSong(old_s);
+		old_s = std::move(s);
+		m_durations.set(pos, old_s.getDuration());
+	}
+	else // otherwise just add it to playlist
+	{
+		m_durations.push_back(s.getDuration());
+		w.addItem(std::move(s));
+	}
+}
+
+void Playlist::truncate(size_t size)
+{
+	if (size < w.size())
+	{
+		for (auto it = w.begin()+size; it != w.end(); ++it)
+			unregisterSong(it->value());
+		w.resizeList(size);
+		m_durations.resize(size);
+	}
+}
+
 namespace {
 
 std::string songToString(const MPD::Song &s);
@@ -195,10 +224,10 @@ void Playlist::applyFilter(const std::string &constraint)
 {
 	if (!constraint.empty())
 	{
-		w.applyFilter(Regex::Filter<MPD::Song>(
-			              constraint,
-			              Config.regex_type,
-			              playlistEntryMatcher));
+		Regex::applyFilter(w, Regex::Filter<MPD::Song>(
+			                     constraint,
+			                     Config.regex_type,
+			                     playlistEntryMatcher));
 	}
 	else
 		w.clearFilter();
@@ -268,17 +297,23 @@ std::string Playlist::getTotalLength()
 	
 	if (m_reload_total_length)
 	{
-		m_total_length = 0;
-		for (const auto &s : w)
-			m_total_length += s.value().getDuration();
+		if (w.isFiltered())
+		{
+			m_total_length = 0;
+			for (const auto &s : w)
+				m_total_length += s.value().getDuration();
+		}
+		else
+			m_total_length = m_durations.sum();
 		m_reload_total_length = false;
 	}
 	if (Config.playlist_show_remaining_time && m_reload_remaining)
 	{
-		ScopedUnfilteredMenu<MPD::Song> sunfilter(ReapplyFilter::No, w);
-		m_remaining_time = 0;
-		for (size_t i = Status::State::currentSongPosition(); i < w.size(); ++i)
-			m_remaining_time += w[i].value().getDuration();
+		int pos = Status::State::currentSongPosition();
+		if (pos >= 0 && size_t(pos) < m_durations.size())
+			m_remaining_time = m_durations.sum() - m_durations.prefixSum(pos);
+		else
+			m_remaining_time = 0;
 		m_reload_remaining = false;
 	}
 	
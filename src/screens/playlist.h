@@ -29,6 +29,7 @@
 #include "screens/screen.h"
 #include "song.h"
 #include "song_list.h"
+#include "utility/fenwick_tree.h"
 
 struct Playlist: Screen<SongMenu>, Filterable, HasSongs, Searchable, Tabbable
 {
@@ -78,6 +79,11 @@ struct Playlist: Screen<SongMenu>, Filterable, HasSongs, Searchable, Tabbable
 	bool checkForSong(const MPD::Song &s);
 	void registerSong(const MPD::Song &s);
 	void unregisterSong(const MPD::Song &s);
+
+	// Replace song at a given position or append it to the playlist.
+	void setSong(size_t pos, MPD::Song s);
+	// Remove songs past a given size of the playlist.
+	void truncate(size_t size);
 	
 	void reloadTotalLength() { m_reload_total_length = true; }
 	void reloadRemaining() { m_reload_remaining = true; }
@@ -88,6 +94,7 @@ private:
 	std::string m_stats;
 	
 	std::unordered_map<MPD::Song, int, MPD::Song::Hash> m_song_refs;
+	FenwickTree<size_t> m_durations;
 	
 	size_t m_total_length;;
 	size_t m_remaining_time;
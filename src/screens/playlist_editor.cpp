@@ -345,10 +345,10 @@ void PlaylistEditor::applyFilter(const std::string &constraint)
 	{
 		if (!constraint.empty())
 		{
-			Playlists.applyFilter(Regex::Filter<MPD::Playlist>(
-				                      constraint,
-				                      Config.regex_type,
-				                      PlaylistEntryMatcher));
+			Regex::applyFilter(Playlists, Regex::Filter<MPD::Playlist>(
+				                             constraint,
+				                             Config.regex_type,
+				                             PlaylistEntryMatcher));
 		}
 		else
 			Playlists.clearFilter();
@@ -357,10 +357,10 @@ void PlaylistEditor::applyFilter(const std::string &constraint)
 	{
 		if (!constraint.empty())
 		{
-			Content.applyFilter(Regex::Filter<MPD::Song>(
-				                    constraint,
-				                    Config.regex_type,
-				                    SongEntryMatcher));
+			Regex::applyFilter(Content, Regex::Filter<MPD::Song>(
+				                           constraint,
+				                           Config.regex_type,
+				                           SongEntryMatcher));
 		}
 		else
 			Content.clearFilter();
@@ -23,6 +23,7 @@
 #include <iomanip>
 
 #include "curses/menu_impl.h"
+#include "database_cache.h"
 #include "display.h"
 #include "global.h"
 #include "helpers.h"
@@ -126,6 +127,16 @@ ConstSongIterator SearchEngineWindow::endS() const
 	return makeConstSongIterator(end());
 }
 
+const MPD::Song *SearchEngineWindow::songAt(size_t pos) const
+{
+	return menuSongAt(*this, pos);
+}
+
+const MPD::Song *SearchEngineWindow::currentSong() const
+{
+	return menuCurrentSong(*this);
+}
+
 std::vector<MPD::Song> SearchEngineWindow::getSelectedSongs()
 {
 	std::vector<MPD::Song> result;
@@ -174,6 +185,7 @@ size_t SearchEngine::SearchButton = 15;
 
 SearchEngine::SearchEngine()
 : Screen(NC::Menu<SEItem>(0, MainStartY, COLS, MainHeight, "", Config.main_color, NC::Border()))
+, m_search_id(0)
 {
 	setHighlightFixes(w);
 	w.cyclicScrolling(Config.use_cyclic_scrolling);
@@ -288,10 +300,10 @@ void SearchEngine::applyFilter(const std::string &constraint)
 {
 	if (!constraint.empty())
 	{
-		w.applyFilter(Regex::ItemFilter<SEItem>(
-			              constraint,
-			              Config.regex_type,
-			              std::bind(SEItemEntryMatcher, ph::_1, ph::_2, true)));
+		Regex::applyFilter(w, Regex::ItemFilter<SEItem>(
+			                     constraint,
+			                     Config.regex_type,
+			                     std::bind(SEItemEntryMatcher, ph::_1, ph::_2, true)));
 	}
 	else
 		w.clearFilter();
@@ -338,34 +350,8 @@ void SearchEngine::runAction()
 		Statusbar::print("Searching...");
 		if (w.size() > StaticOptions)
 			Prepare();
-		Search();
-		if (w.rbegin()->value().isSong())
-		{
-			if (Config.search_engine_display_mode == DisplayMode::Columns)
-				w.setTitle(Config.titles_visibility ? Display::Columns(w.getWidth()) : "");
-			size_t found = w.size()-SearchEngine::StaticOptions;
-			found += 3; // don't count options inserted below
-			w.insertSeparator(ResetButton+1);
-			w.insertItem(ResetButton+2, SEItem(), NC::List::Properties::Inactive);
-			w.at(ResetButton+2).value().mkBuffer()
-				<< NC::Format::Bold
-				<< Config.color1
-				<< "Search results: "
-				<< NC::FormattedColor::End<>(Config.color1)
-				<< Config.color2
-				<< "Found " << found << (found > 1 ? " songs" : " song")
-				<< NC::FormattedColor::End<>(Config.color2)
-				<< NC::Format::NoBold;
-			w.insertSeparator(ResetButton+3);
-				Statusbar::print("Searching finished");
-			if (Config.block_search_constraints_change)
-				for (size_t i = 0; i < StaticOptions-4; ++i)
-					w.at(i).setInactive(true);
-			w.scroll(NC::Scroll::Down);
-			w.scroll(NC::Scroll::Down);
-		}
-		else
-			Statusbar::print("No results found");
+		if (Search())
+			showResults();
 	}
 	else if (option == ResetButton)
 	{
@@ -375,6 +361,37 @@ void SearchEngine::runAction()
 		addSongToPlaylist(w.current()->value().song(), true);
 }
 
+void SearchEngine::showResults()
+{
+	if (w.rbegin()->value().isSong())
+	{
+		if (Config.search_engine_display_mode == DisplayMode::Columns)
+			w.setTitle(Config.titles_visibility ? Display::Columns(w.getWidth()) : "");
+		size_t found = w.size()-SearchEngine::StaticOptions;
+		found += 3; // don't count options inserted below
+		w.insertSeparator(ResetButton+1);
+		w.insertItem(ResetButton+2, SEItem(), NC::List::Properties::Inactive);
+		w.at(ResetButton+2).value().mkBuffer()
+			<< NC::Format::Bold
+			<< Config.color1
+			<< "Search results: "
+			<< NC::FormattedColor::End<>(Config.color1)
+			<< Config.color2
+			<< "Found " << found << (found > 1 ? " songs" : " song")
+			<< NC::FormattedColor::End<>(Config.color2)
+			<< NC::Format::NoBold;
+		w.insertSeparator(ResetButton+3);
+		Statusbar::print("Searching finished");
+		if (Config.block_search_constraints_change)
+			for (size_t i = 0; i < StaticOptions-4; ++i)
+				w.at(i).setInactive(true);
+		w.scroll(NC::Scroll::Down);
+		w.scroll(NC::Scroll::Down);
+	}
+	else
+		Statusbar::print("No results found");
+}
+
 /***********************************************************************/
 
 bool SearchEngine::itemAvailable()
@@ -428,11 +445,14 @@ void SearchEngine::reset()
 	w.clearFilter();
 	w.reset();
 	Prepare();
+	// Discard results of a search that is still running.
+	++m_search_id;
 	Statusbar::print("Search state reset");
 }
 
-void SearchEngine::Search()
+bool SearchEngine::Search()
 {
+	unsigned search_id = ++m_search_id;
 	bool constraints_empty = 1;
 	for (size_t i = 0; i < ConstraintsNumber; ++i)
 	{
@@ -443,36 +463,53 @@ void SearchEngine::Search()
 		}
 	}
 	if (constraints_empty)
-		return;
+		return true;
 	
 	if (Config.search_in_db && (SearchMode == &SearchModes[0] || SearchMode == &SearchModes[2])) // use built-in mpd searching
 	{
-		Mpd.StartSearch(SearchMode == &SearchModes[2]);
-		if (!itsConstraints[0].empty())
-			Mpd.AddSearchAny(itsConstraints[0]);
-		if (!itsConstraints[1].empty())
-			Mpd.AddSearch(MPD_TAG_ARTIST, itsConstraints[1]);
-		if (!itsConstraints[2].empty())
-			Mpd.AddSearch(MPD_TAG_ALBUM_ARTIST, itsConstraints[2]);
-		if (!itsConstraints[3].empty())
-			Mpd.AddSearch(MPD_TAG_TITLE, itsConstraints[3]);
-		if (!itsConstraints[4].empty())
-			Mpd.AddSearch(MPD_TAG_ALBUM, itsConstraints[4]);
-		if (!itsConstraints[5].empty())
-			Mpd.AddSearchURI(itsConstraints[5]);
-		if (!itsConstraints[6].empty())
-			Mpd.AddSearch(MPD_TAG_COMPOSER, itsConstraints[6]);
-		if (!itsConstraints[7].empty())
-			Mpd.AddSearch(MPD_TAG_PERFORMER, itsConstraints[7]);
-		if (!itsConstraints[8].empty())
-			Mpd.AddSearch(MPD_TAG_GENRE, itsConstraints[8]);
-		if (!itsConstraints[9].empty())
-			Mpd.AddSearch(MPD_TAG_DATE, itsConstraints[9]);
-		if (!itsConstraints[10].empty())
-			Mpd.AddSearch(MPD_TAG_COMMENT, itsConstraints[10]);
-		for (MPD::SongIterator s = Mpd.CommitSearchSongs(), end; s != end; ++s)
-			w.addItem(std::move(*s));
-		return;
+		// Searching the whole database may take a while, so it's done on the
+		// worker connection to keep the interface responsive.
+		std::vector<std::string> constraints(itsConstraints, itsConstraints+ConstraintsNumber);
+		bool exact_match = SearchMode == &SearchModes[2];
+		MpdWorker.submit(
+			[constraints, exact_match](MPD::Connection &c) {
+				c.StartSearch(exact_match);
+				if (!constraints[0].empty())
+					c.AddSearchAny(constraints[0]);
+				if (!constraints[1].empty())
+					c.AddSearch(MPD_TAG_ARTIST, constraints[1]);
+				if (!constraints[2].empty())
+					c.AddSearch(MPD_TAG_ALBUM_ARTIST, constraints[2]);
+				if (!constraints[3].empty())
+					c.AddSearch(MPD_TAG_TITLE, constraints[3]);
+				if (!constraints[4].empty())
+					c.AddSearch(MPD_TAG_ALBUM, constraints[4]);
+				if (!constraints[5].empty())
+					c.AddSearchURI(constraints[5]);
+				if (!constraints[6].empty())
+					c.AddSearch(MPD_TAG_COMPOSER, constraints[6]);
+				if (!constraints[7].empty())
+					c.AddSearch(MPD_TAG_PERFORMER, constraints[7]);
+				if (!constraints[8].empty())
+					c.AddSearch(MPD_TAG_GENRE, constraints[8]);
+				if (!constraints[9].empty())
+					c.AddSearch(MPD_TAG_DATE, constraints[9]);
+				if (!constraints[10].empty())
+					c.AddSearch(MPD_TAG_COMMENT, constraints[10]);
+				return std::vector<MPD::Song>(
+					std::make_move_iterator(c.CommitSearchSongs()),
+					std::make_move_iterator(MPD::SongIterator()));
+			},
+			[this, search_id](std::vector<MPD::Song> songs) {
+				if (search_id != m_search_id)
+					return;
+				for (auto &s : songs)
+					w.addItem(std::move(s));
+				showResults();
+				if (isVisible(this))
+					w.refresh();
+			});
+		return false;
 	}
 
 	Regex::Regex rx[ConstraintsNumber];
@@ -500,8 +537,8 @@ void SearchEngine::Search()
 	input_song_iterator s, end;
 	if (Config.search_in_db)
 	{
-		s = input_song_iterator(Mpd.GetDirectoryRecursive("/"));
-		end = input_song_iterator(MPD::SongIterator());
+		s = input_song_iterator(DatabaseCache::songs());
+		end = input_song_iterator(DatabaseCache::SongIterator());
 	}
 	else
 	{
@@ -509,6 +546,22 @@ void SearchEngine::Search()
 		end = input_song_iterator(myPlaylist->main().endV());
 	}
 
+	// Tags corresponding to constraints 1-10, all of them are searched for the
+	// first one.
+	const std::array<MPD::Song::PeekFunction, ConstraintsNumber-1> tags = {{
+		&MPD::Song::peekArtist,
+		&MPD::Song::peekAlbumArtist,
+		&MPD::Song::peekTitle,
+		&MPD::Song::peekAlbum,
+		&MPD::Song::peekName,
+		&MPD::Song::peekComposer,
+		&MPD::Song::peekPerformer,
+		&MPD::Song::peekGenre,
+		&MPD::Song::peekDate,
+		&MPD::Song::peekComment
+	}};
+	std::string buffer;
+
 	LocaleStringComparison cmp(std::locale(), Config.ignore_leading_the);
 	for (; s != end; ++s)
 	{
@@ -516,79 +569,39 @@ void SearchEngine::Search()
 
 		if (SearchMode != &SearchModes[2]) // match to pattern
 		{
+			auto matches = [&](size_t i, const Regex::Regex &r) {
+				return Regex::search(((*s).*tags[i])(0, buffer), r, Config.ignore_diacritics);
+			};
 			if (!rx[0].empty())
-				any_found =
-					   Regex::search(s->getArtist(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getAlbumArtist(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getTitle(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getAlbum(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getName(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getComposer(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getPerformer(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getGenre(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getDate(), rx[0], Config.ignore_diacritics)
-					|| Regex::search(s->getComment(), rx[0], Config.ignore_diacritics);
-			if (found && !rx[1].empty())
-				found = Regex::search(s->getArtist(), rx[1], Config.ignore_diacritics);
-			if (found && !rx[2].empty())
-				found = Regex::search(s->getAlbumArtist(), rx[2], Config.ignore_diacritics);
-			if (found && !rx[3].empty())
-				found = Regex::search(s->getTitle(), rx[3], Config.ignore_diacritics);
-			if (found && !rx[4].empty())
-				found = Regex::search(s->getAlbum(), rx[4], Config.ignore_diacritics);
-			if (found && !rx[5].empty())
-				found = Regex::search(s->getName(), rx[5], Config.ignore_diacritics);
-			if (found && !rx[6].empty())
-				found = Regex::search(s->getComposer(), rx[6], Config.ignore_diacritics);
-			if (found && !rx[7].empty())
-				found = Regex::search(s->getPerformer(), rx[7], Config.ignore_diacritics);
-			if (found && !rx[8].empty())
-				found = Regex::search(s->getGenre(), rx[8], Config.ignore_diacritics);
-			if (found && !rx[9].empty())
-				found = Regex::search(s->getDate(), rx[9], Config.ignore_diacritics);
-			if (found && !rx[10].empty())
-				found = Regex::search(s->getComment(), rx[10], Config.ignore_diacritics);
+			{
+				any_found = false;
+				for (size_t i = 0; !any_found && i < tags.size(); ++i)
+					any_found = matches(i, rx[0]);
+			}
+			for (size_t i = 0; found && i < tags.size(); ++i)
+				if (!rx[i+1].empty())
+					found = matches(i, rx[i+1]);
 		}
 		else // match only if values are equal
 		{
+			auto equals = [&](size_t i, const std::string &constraint) {
+				return !cmp(((*s).*tags[i])(0, buffer), constraint);
+			};
 			if (!itsConstraints[0].empty())
-				any_found =
-				   !cmp(s->getArtist(), itsConstraints[0])
-				|| !cmp(s->getAlbumArtist(), itsConstraints[0])
-				|| !cmp(s->getTitle(), itsConstraints[0])
-				|| !cmp(s->getAlbum(), itsConstraints[0])
-				|| !cmp(s->getName(), itsConstraints[0])
-				|| !cmp(s->getComposer(), itsConstraints[0])
-				|| !cmp(s->getPerformer(), itsConstraints[0])
-				|| !cmp(s->getGenre(), itsConstraints[0])
-				|| !cmp(s->getDate(), itsConstraints[0])
-				|| !cmp(s->getComment(), itsConstraints[0]);
-			
-			if (found && !itsConstraints[1].empty())
-				found = !cmp(s->getArtist(), itsConstraints[1]);
-			if (found && !itsConstraints[2].empty())
-				found = !cmp(s->getAlbumArtist(), itsConstraints[2]);
-			if (found && !itsConstraints[3].empty())
-				found = !cmp(s->getTitle(), itsConstraints[3]);
-			if (found && !itsConstraints[4].empty())
-				found = !cmp(s->getAlbum(), itsConstraints[4]);
-			if (found && !itsConstraints[5].empty())
-				found = !cmp(s->getName(), itsConstraints[5]);
-			if (found && !itsConstraints[6].empty())
-				found = !cmp(s->getComposer(), itsConstraints[6]);
-			if (found && !itsConstraints[7].empty())
-				found = !cmp(s->getPerformer(), itsConstraints[7]);
-			if (found && !itsConstraints[8].empty())
-				found = !cmp(s->getGenre(), itsConstraints[8]);
-			if (found && !itsConstraints[9].empty())
-				found = !cmp(s->getDate(), itsConstraints[9]);
-			if (found && !itsConstraints[10].empty())
-				found = !cmp(s->getComment(), itsConstraints[10]);
+			{
+				any_found = false;
+				for (size_t i = 0; !any_found && i < tags.size(); ++i)
+					any_found = equals(i, itsConstraints[0]);
+			}
+			for (size_t i = 0; found && i < tags.size(); ++i)
+				if (!itsConstraints[i+1].empty())
+					found = equals(i, itsConstraints[i+1]);
 		}
 		
 		if (any_found && found)
 			w.addItem(*s);
 	}
+	return true;
 }
 
 namespace {
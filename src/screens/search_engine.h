@@ -88,6 +88,9 @@ struct SearchEngineWindow: NC::Menu<SEItem>, SongList
 	virtual SongIterator endS() override;
 	virtual ConstSongIterator endS() const override;
 
+	virtual const MPD::Song *songAt(size_t pos) const override;
+	virtual const MPD::Song *currentSong() const override;
+
 	virtual std::vector<MPD::Song> getSelectedSongs() override;
 };
 
@@ -139,7 +142,14 @@ struct SearchEngine: Screen<SearchEngineWindow>, Filterable, HasActions, HasSong
 	
 private:
 	void Prepare();
-	void Search();
+	// Returns false if the search is run on the worker connection, results are
+	// shown once it's finished then.
+	bool Search();
+	void showResults();
+
+	// Incremented on each search, so that results of outdated searches run on
+	// the worker connection are discarded.
+	unsigned m_search_id;
 
 	Regex::ItemFilter<SEItem> m_search_predicate;
 	
@@ -18,6 +18,9 @@
  *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
  ***************************************************************************/
 
+#include <algorithm>
+#include <numeric>
+
 #include "curses/menu_impl.h"
 #include "charset.h"
 #include "display.h"
@@ -26,12 +29,100 @@
 #include "screens/playlist.h"
 #include "settings.h"
 #include "screens/sort_playlist.h"
+#include "song_store.h"
 #include "statusbar.h"
 #include "utility/comparators.h"
+#include "utility/fenwick_tree.h"
 #include "screens/screen_switcher.h"
 
 SortPlaylistDialog *mySortPlaylistDialog;
 
+namespace {
+
+// Compute a sequence of moves that rearranges a list so that its i-th element
+// becomes the one at position order[i]. Elements forming the longest increasing
+// subsequence of target positions stay in place and each of the others is moved
+// once, right after its predecessor in the target order, which makes the number
+// of moves minimal.
+std::vector<std::pair<size_t, size_t>> minimalMoves(const std::vector<size_t> &order)
+{
+	const size_t none = -1;
+	size_t n = order.size();
+	std::vector<size_t> target(n);
+	for (size_t i = 0; i < n; ++i)
+		target[order[i]] = i;
+
+	// Find the longest increasing subsequence of target positions.
+	std::vector<size_t> tails, prev(n, none);
+	for (size_t i = 0; i < n; ++i)
+	{
+		auto it = std::lower_bound(tails.begin(), tails.end(), i,
+			[&target](size_t a, size_t b) { return target[a] < target[b]; });
+		if (it != tails.begin())
+			prev[i] = *(it-1);
+		if (it == tails.end())
+			tails.push_back(i);
+		else
+			*it = i;
+	}
+	std::vector<bool> stays(n, false);
+	if (!tails.empty())
+		for (size_t i = tails.back(); i != none; i = prev[i])
+			stays[i] = true;
+
+	// Elements that are moved are placed in blocks following the elements that
+	// stay (or at the beginning). Assign each of them its place in a block.
+	std::vector<size_t> block_size(n+1, 0), block(n), place(n);
+	size_t current_block = 0;
+	for (size_t t = 0; t < n; ++t)
+	{
+		size_t i = order[t];
+		if (stays[i])
+			current_block = i+1;
+		else
+		{
+			block[i] = current_block;
+			place[i] = block_size[current_block]++;
+		}
+	}
+
+	// Lay out slots for the original positions of the elements interleaved with
+	// the blocks, so that the current position of an element is the number of
+	// occupied slots before its slot.
+	std::vector<size_t> original_slot(n), block_start(n+1);
+	size_t slots = 0;
+	block_start[0] = slots;
+	slots += block_size[0];
+	for (size_t i = 0; i < n; ++i)
+	{
+		original_slot[i] = slots++;
+		block_start[i+1] = slots;
+		slots += block_size[i+1];
+	}
+	FenwickTree<size_t> occupied;
+	occupied.resize(slots);
+	for (size_t i = 0; i < n; ++i)
+		occupied.set(original_slot[i], 1);
+
+	std::vector<std::pair<size_t, size_t>> moves;
+	moves.reserve(n - tails.size());
+	for (size_t t = 0; t < n; ++t)
+	{
+		size_t i = order[t];
+		if (stays[i])
+			continue;
+		size_t from = occupied.prefixSum(original_slot[i]);
+		occupied.set(original_slot[i], 0);
+		size_t slot = block_start[block[i]] + place[i];
+		size_t to = occupied.prefixSum(slot);
+		occupied.set(slot, 1);
+		moves.emplace_back(from, to);
+	}
+	return moves;
+}
+
+}
+
 SortPlaylistDialog::SortPlaylistDialog()
 {
 	typedef WindowType::Item::Type Entry;
@@ -172,49 +263,35 @@ void SortPlaylistDialog::sort() const
 		return;
 
 	size_t start_pos = begin - pl.begin();
-	std::vector<MPD::Song> playlist;
-	playlist.reserve(end - begin);
+	MPD::SongStore::Fields fields;
+	for (auto it = w.beginV(); it->item().second; ++it)
+		fields.push_back(it->item().second);
+	MPD::SongStore store(std::move(fields));
 	for (; begin != end; ++begin)
-		playlist.push_back(begin->value());
-	
-	typedef std::vector<MPD::Song>::iterator Iterator;
-	LocaleStringComparison cmp(std::locale(), Config.ignore_leading_the);
-	std::function<void(Iterator, Iterator)> iter_swap, quick_sort;
-	auto song_cmp = [this, &cmp](const MPD::Song &a, const MPD::Song &b) -> bool {
-		for (auto it = w.beginV();  it->item().second; ++it)
-		{
-			int res = cmp(a.getTags(it->item().second),
-			              b.getTags(it->item().second));
-			if (res != 0)
-				return res < 0;
-		}
-		return a.getPosition() < b.getPosition();
-	};
-	iter_swap = [&playlist, &start_pos](Iterator a, Iterator b) {
-		std::iter_swap(a, b);
-		Mpd.Swap(start_pos+a-playlist.begin(), start_pos+b-playlist.begin());
-	};
-	quick_sort = [&song_cmp, &quick_sort, &iter_swap](Iterator first, Iterator last) {
-		if (last-first > 1)
+		store.add(begin->value());
+
+	// Tags are interned and ranked once, so the order can be computed locally
+	// and applied with as few moves as possible instead of a swap per step.
+	auto ranks = store.strings().ranks(
+		LocaleStringComparison(std::locale(), Config.ignore_leading_the));
+	std::vector<size_t> order(store.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		for (size_t field = 0; field < store.fields().size(); ++field)
 		{
-			Iterator pivot = first+Global::RNG()%(last-first);
-			iter_swap(pivot, last-1);
-			pivot = last-1;
-			
-			Iterator tmp = first;
-			for (Iterator i = first; i != pivot; ++i)
-				if (song_cmp(*i, *pivot))
-					iter_swap(i, tmp++);
-			iter_swap(tmp, pivot);
-			
-			quick_sort(first, tmp);
-			quick_sort(tmp+1, last);
+			auto rank_a = ranks[store.id(a, field)];
+			auto rank_b = ranks[store.id(b, field)];
+			if (rank_a != rank_b)
+				return rank_a < rank_b;
 		}
-	};
-	
+		return false;
+	});
+	auto moves = minimalMoves(order);
+
 	Statusbar::print("Sorting...");
 	Mpd.StartCommandsList();
-	quick_sort(playlist.begin(), playlist.end());
+	for (const auto &move : moves)
+		Mpd.Move(start_pos+move.first, start_pos+move.second);
 	Mpd.CommitCommandsList();
 	Statusbar::print("Range sorted");
 	switchToPreviousScreen();
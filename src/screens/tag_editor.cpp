@@ -120,6 +120,16 @@ ConstSongIterator TagsWindow::endS() const
 	return makeConstSongIterator(end());
 }
 
+const MPD::Song *TagsWindow::songAt(size_t pos) const
+{
+	return menuSongAt(*this, pos);
+}
+
+const MPD::Song *TagsWindow::currentSong() const
+{
+	return menuCurrentSong(*this);
+}
+
 std::vector<MPD::Song> TagsWindow::getSelectedSongs()
 {
 	return {}; // TODO
@@ -46,6 +46,9 @@ struct TagsWindow: NC::Menu<MPD::MutableSong>, SongList
 	virtual SongIterator endS() override;
 	virtual ConstSongIterator endS() const override;
 
+	virtual const MPD::Song *songAt(size_t pos) const override;
+	virtual const MPD::Song *currentSong() const override;
+
 	virtual std::vector<MPD::Song> getSelectedSongs() override;
 };
 
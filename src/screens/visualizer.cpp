@@ -32,6 +32,8 @@
 #include <limits>
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
 #include <cassert>
 #include <linux/in.h>
 
@@ -45,8 +47,6 @@
 #include "enums.h"
 #include "utility/wide_string.h"
 
-using Samples = std::vector<int16_t>;
-
 using Global::MainStartY;
 using Global::MainHeight;
 
@@ -66,20 +66,67 @@ const NC::FormattedColor &toColor(size_t number, size_t max, bool wrap)
 	];
 }
 
+// Loops below are kept free of branches and dependencies between iterations
+// other than reductions, so that compilers can vectorize them.
+
+// Largest absolute value among samples.
+int32_t peakAmplitude(const int16_t *samples, size_t n)
+{
+	int16_t min = 0, max = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		min = std::min(min, samples[i]);
+		max = std::max(max, samples[i]);
+	}
+	return std::max(-int32_t(min), int32_t(max));
+}
+
+// Multiply samples by a factor, saturating the results.
+void scaleSamples(int16_t *samples, size_t n, float factor)
+{
+	const float min = std::numeric_limits<int16_t>::min();
+	const float max = std::numeric_limits<int16_t>::max();
+	for (size_t i = 0; i < n; ++i)
+	{
+		float sample = samples[i] * factor;
+		sample = std::min(sample, max);
+		sample = std::max(sample, min);
+		samples[i] = sample;
+	}
+}
+
+#ifdef HAVE_FFTW3_H
+// Wisdom of single and double precision versions of fftw is not compatible.
+#	ifdef HAVE_FFTW3F
+const char *WISDOM_FILENAME = "fftwf_wisdom";
+#	else
+const char *WISDOM_FILENAME = "fftw_wisdom";
+#	endif // HAVE_FFTW3F
+
+void squaredMagnitudes(double *output, const RealFFT::Complex *input, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		output[i] = input[i][0]*input[i][0] + input[i][1]*input[i][1];
+}
+#endif // HAVE_FFTW3_H
+
 }
 
 Visualizer::Visualizer()
 : Screen(NC::Window(0, MainStartY, COLS, MainHeight, "", NC::Color::Default, NC::Border()))
-, m_output_id(-1)
-, m_reset_output(false)
 , m_source_fd(-1)
-, m_sample_consumption_rate(5)
-, m_sample_consumption_rate_up_ctr(0)
-, m_sample_consumption_rate_dn_ctr(0)
+, m_block_interval(0)
+, m_stop_frame_renderer(false)
+, m_frame_ready(false)
+, m_reset_auto_scale(false)
+, m_auto_scale_multiplier(1)
 #	ifdef HAVE_FFTW3_H
 	,
   DFT_NONZERO_SIZE(2048 * (2*Config.visualizer_spectrum_dft_size + 4)),
   DFT_TOTAL_SIZE(1 << 15),
+  DFT_HOP(Config.visualizer_spectrum_rate > 0
+          ? 44100 / Config.visualizer_spectrum_rate
+          : 0),
   DYNAMIC_RANGE(100-Config.visualizer_spectrum_gain),
   HZ_MIN(Config.visualizer_spectrum_hz_min),
   HZ_MAX(Config.visualizer_spectrum_hz_max),
@@ -90,14 +137,10 @@ Visualizer::Visualizer()
 	InitDataSource();
 	InitVisualization();
 #	ifdef HAVE_FFTW3_H
-	m_fftw_results = DFT_TOTAL_SIZE/2+1;
-	m_freq_magnitudes.resize(m_fftw_results);
-	m_fftw_input = static_cast<double *>(fftw_malloc(sizeof(double)*DFT_TOTAL_SIZE));
-	memset(m_fftw_input, 0, sizeof(double)*DFT_TOTAL_SIZE);
-	m_fftw_output = static_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex)*m_fftw_results));
-	m_fftw_plan = fftw_plan_dft_r2c_1d(DFT_TOTAL_SIZE, m_fftw_input, m_fftw_output, FFTW_ESTIMATE);
-	m_dft_logspace.reserve(500);
-	m_bar_heights.reserve(100);
+	m_samples_since_dft = 0;
+	m_dft_due = true;
+	m_freq_magnitudes.resize(DFT_TOTAL_SIZE/2+1);
+	GenWindow();
 #	endif // HAVE_FFTW3_H
 }
 
@@ -105,26 +148,33 @@ void Visualizer::switchTo()
 {
 	SwitchTo::execute(this);
 	Clear();
-	m_reset_output = true;
 	drawHeader();
 #	ifdef HAVE_FFTW3_H
+	const bool rendering = m_frame_renderer.joinable();
+	StopFrameRenderer();
 	GenLogspace();
-	m_bar_heights.reserve(w.getWidth());
+	if (rendering)
+		StartFrameRenderer();
 #	endif // HAVE_FFTW3_H
+	Resume();
 }
 
 void Visualizer::resize()
 {
 	size_t x_offset, width;
 	getWindowResizeParams(x_offset, width);
+	// Frames are computed for the current size of the window.
+	const bool rendering = m_frame_renderer.joinable();
+	StopFrameRenderer();
 	w.resize(width, MainHeight);
 	w.moveTo(x_offset, MainStartY);
 	hasToBeResized = 0;
 	InitVisualization();
 #	ifdef HAVE_FFTW3_H
 	GenLogspace();
-	m_bar_heights.reserve(w.getWidth());
 #	endif // HAVE_FFTW3_H
+	if (rendering)
+		StartFrameRenderer();
 }
 
 std::wstring Visualizer::title()
@@ -137,101 +187,20 @@ void Visualizer::update()
 	if (m_source_fd < 0)
 		return;
 
-	// Disable and enable FIFO to get rid of the difference between audio and
-	// visualization.
-	if (m_reset_output && m_output_id != -1)
-	{
-		Mpd.DisableOutput(m_output_id);
-		usleep(50000);
-		Mpd.EnableOutput(m_output_id);
-		m_reset_output = false;
-	}
-
-	// PCM in format 44100:16:1 (for mono visualization) and
-	// 44100:16:2 (for stereo visualization) is supported.
-	ssize_t bytes_read = read(m_source_fd, m_incoming_samples.data(),
-	                          sizeof(int16_t) * m_incoming_samples.size());
-	if (bytes_read > 0)
-	{
-		const auto begin = m_incoming_samples.begin();
-		const auto end = m_incoming_samples.begin() + bytes_read/sizeof(int16_t);
-
-		if (Config.visualizer_autoscale)
-		{
-			m_auto_scale_multiplier += 1.0/Config.visualizer_fps;
-			for (auto sample = begin; sample != end; ++sample)
-			{
-				double scale = std::numeric_limits<int16_t>::min();
-				scale /= *sample;
-				scale = fabs(scale);
-				if (scale < m_auto_scale_multiplier)
-					m_auto_scale_multiplier = scale;
-			}
-			for (auto sample = begin; sample != end; ++sample)
-			{
-				int32_t tmp = *sample;
-				if (m_auto_scale_multiplier <= 50.0) // limit the auto scale
-					tmp *= m_auto_scale_multiplier;
-				if (tmp < std::numeric_limits<int16_t>::min())
-					*sample = std::numeric_limits<int16_t>::min();
-				else if (tmp > std::numeric_limits<int16_t>::max())
-					*sample = std::numeric_limits<int16_t>::max();
-				else
-					*sample = tmp;
-			}
-		}
-		m_buffered_samples.put(begin, end);
-	}
-
-	size_t requested_samples =
-		44100.0 / Config.visualizer_fps * pow(1.1, m_sample_consumption_rate);
-	if (Config.visualizer_in_stereo)
-		requested_samples *= 2;
-
-	//Statusbar::printf("Samples: %1%, %2%, %3%", m_buffered_samples.size(),
-	//                  requested_samples, m_sample_consumption_rate);
-
-	size_t new_samples = m_buffered_samples.get(requested_samples, m_rendered_samples);
-	if (new_samples == 0)
+	std::lock_guard<std::mutex> lock(m_frame_mutex);
+	if (!m_frame_ready)
 		return;
-
-	// A crude way to adjust the amount of samples consumed from the buffer
-	// depending on how fast the rendering is.
-	if (m_buffered_samples.size() > 0)
-	{
-		if (++m_sample_consumption_rate_up_ctr > 8)
-		{
-			m_sample_consumption_rate_up_ctr = 0;
-			++m_sample_consumption_rate;
-		}
-	}
-	else if (m_sample_consumption_rate > 0)
-	{
-		if (++m_sample_consumption_rate_dn_ctr > 4)
-		{
-			m_sample_consumption_rate_dn_ctr = 0;
-			--m_sample_consumption_rate;
-		}
-		m_sample_consumption_rate_up_ctr = 0;
-	}
+	m_frame_ready = false;
 
 	w.clear();
-	if (Config.visualizer_in_stereo)
-	{
-		auto chan_samples = m_rendered_samples.size()/2;
-		int16_t buf_left[chan_samples], buf_right[chan_samples];
-		for (size_t i = 0, j = 0; i < m_rendered_samples.size(); i += 2, ++j)
-		{
-			buf_left[j] = m_rendered_samples[i];
-			buf_right[j] = m_rendered_samples[i+1];
-		}
-		size_t half_height = w.getHeight()/2;
-
-		(this->*drawStereo)(buf_left, buf_right, chan_samples, half_height);
-	}
-	else
+	for (const auto &cell : m_frame)
 	{
-		(this->*draw)(m_rendered_samples.data(), m_rendered_samples.size(), 0, w.getHeight());
+		w << NC::XY(cell.x, cell.y) << *cell.color;
+		if (cell.reversed)
+			w << NC::Format::Reverse << cell.ch << NC::Format::NoReverse;
+		else
+			w << cell.ch;
+		w << NC::FormattedColor::End<>(*cell.color);
 	}
 	w.refresh();
 }
@@ -246,23 +215,20 @@ int Visualizer::windowTimeout()
 
 /**********************************************************************/
 
-void Visualizer::DrawSoundWave(const int16_t *buf, ssize_t samples, size_t y_offset, size_t height)
+void Visualizer::DrawSoundWave(const Samples &buf, size_t y_offset, size_t height)
 {
 	const size_t half_height = height/2;
 	const size_t base_y = y_offset+half_height;
 	const size_t win_width = w.getWidth();
-	const int samples_per_column = samples/win_width;
+	const int samples_per_column = buf.size()/win_width;
 
 	// too little samples
 	if (samples_per_column == 0)
 		return;
 
 	auto draw_point = [&](size_t x, int32_t y) {
-		auto c = toColor(std::abs(y), half_height, false);
-		w << NC::XY(x, base_y+y)
-		  << c
-		  << Config.visualizer_chars[0]
-		  << NC::FormattedColor::End<>(c);
+		const auto &c = toColor(std::abs(y), half_height, false);
+		DrawCell(x, base_y+y, c, Config.visualizer_chars[0]);
 	};
 
 	int32_t point_y, prev_point_y = 0;
@@ -298,10 +264,10 @@ void Visualizer::DrawSoundWave(const int16_t *buf, ssize_t samples, size_t y_off
 	}
 }
 
-void Visualizer::DrawSoundWaveStereo(const int16_t *buf_left, const int16_t *buf_right, ssize_t samples, size_t height)
+void Visualizer::DrawSoundWaveStereo(const Samples &buf_left, const Samples &buf_right, size_t height)
 {
-	DrawSoundWave(buf_left, samples, 0, height);
-	DrawSoundWave(buf_right, samples, height, w.getHeight() - height);
+	DrawSoundWave(buf_left, 0, height);
+	DrawSoundWave(buf_right, height, w.getHeight() - height);
 }
 
 /**********************************************************************/
@@ -310,12 +276,12 @@ void Visualizer::DrawSoundWaveStereo(const int16_t *buf_left, const int16_t *buf
 // instead of a single line the entire height is filled. In stereo mode, the top
 // half of the screen is dedicated to the right channel, the bottom the left
 // channel.
-void Visualizer::DrawSoundWaveFill(const int16_t *buf, ssize_t samples, size_t y_offset, size_t height)
+void Visualizer::DrawSoundWaveFill(const Samples &buf, size_t y_offset, size_t height)
 {
 	// if right channel is drawn, bars descend from the top to the bottom
 	const bool flipped = y_offset > 0;
 	const size_t win_width = w.getWidth();
-	const int samples_per_column = samples/win_width;
+	const int samples_per_column = buf.size()/win_width;
 
 	// too little samples
 	if (samples_per_column == 0)
@@ -335,27 +301,25 @@ void Visualizer::DrawSoundWaveFill(const int16_t *buf, ssize_t samples, size_t y
 
 		for (int32_t j = 0; j < point_y; ++j)
 		{
-			auto c = toColor(j, height, false);
+			const auto &c = toColor(j, height, false);
 			size_t y = flipped ? y_offset+j : y_offset+height-j-1;
-			w << NC::XY(x, y)
-			  << c
-			  << Config.visualizer_chars[1]
-			  << NC::FormattedColor::End<>(c);
+			DrawCell(x, y, c, Config.visualizer_chars[1]);
 		}
 	}
 }
 
-void Visualizer::DrawSoundWaveFillStereo(const int16_t *buf_left, const int16_t *buf_right, ssize_t samples, size_t height)
+void Visualizer::DrawSoundWaveFillStereo(const Samples &buf_left, const Samples &buf_right, size_t height)
 {
-	DrawSoundWaveFill(buf_left, samples, 0, height);
-	DrawSoundWaveFill(buf_right, samples, height, w.getHeight() - height);
+	DrawSoundWaveFill(buf_left, 0, height);
+	DrawSoundWaveFill(buf_right, height, w.getHeight() - height);
 }
 
 /**********************************************************************/
 
 // Draws the sound wave as an ellipse with origin in the center of the screen.
-void Visualizer::DrawSoundEllipse(const int16_t *buf, ssize_t samples, size_t, size_t height)
+void Visualizer::DrawSoundEllipse(const Samples &buf, size_t, size_t height)
 {
+	const ssize_t samples = buf.size();
 	const size_t half_width = w.getWidth()/2;
 	const size_t half_height = height/2;
 
@@ -379,11 +343,8 @@ void Visualizer::DrawSoundEllipse(const int16_t *buf, ssize_t samples, size_t, s
 		x *= radius;
 		y *= radius;
 
-		auto c = toColor(sqrt(x*x + y*y), max_radius, false);
-		w << NC::XY(half_width + x, half_height + y)
-		  << c
-		  << Config.visualizer_chars[0]
-		  << NC::FormattedColor::End<>(c);
+		const auto &c = toColor(sqrt(x*x + y*y), max_radius, false);
+		DrawCell(half_width + x, half_height + y, c, Config.visualizer_chars[0]);
 	}
 }
 
@@ -397,8 +358,9 @@ void Visualizer::DrawSoundEllipse(const int16_t *buf, ssize_t samples, size_t, s
 // circle. This visualizer assume the font height is twice the length of the
 // font's width. If the font is skinner or wider than this, instead of a circle
 // it will be an ellipse.
-void Visualizer::DrawSoundEllipseStereo(const int16_t *buf_left, const int16_t *buf_right, ssize_t samples, size_t half_height)
+void Visualizer::DrawSoundEllipseStereo(const Samples &buf_left, const Samples &buf_right, size_t half_height)
 {
+	const ssize_t samples = buf_left.size();
 	const size_t width = w.getWidth();
 	const size_t left_half_width = width/2;
 	const size_t right_half_width = width - left_half_width;
@@ -418,95 +380,36 @@ void Visualizer::DrawSoundEllipseStereo(const int16_t *buf_left, const int16_t *
 		// (y-h)+2 = r^2 centers the circle around the point (w,h). Because fonts
 		// are not all the same size, this will not always generate a perfect
 		// circle.
-		auto c = toColor(sqrt(x*x + 4*y*y), radius, true);
-		w << NC::XY(left_half_width + x, top_half_height + y)
-		  << c
-		  << Config.visualizer_chars[1]
-		  << NC::FormattedColor::End<>(c);
+		const auto &c = toColor(sqrt(x*x + 4*y*y), radius, true);
+		DrawCell(left_half_width + x, top_half_height + y, c, Config.visualizer_chars[1]);
 	}
 }
 
 /**********************************************************************/
 
 #ifdef HAVE_FFTW3_H
-void Visualizer::DrawFrequencySpectrum(const int16_t *buf, ssize_t samples, size_t y_offset, size_t height)
+void Visualizer::DrawFrequencySpectrum(const Samples &buf, size_t y_offset, size_t height)
 {
 	// If right channel is drawn, bars descend from the top to the bottom.
 	const bool flipped = y_offset > 0;
 
-	// copy samples to fftw input array and apply Hamming window
-	ApplyWindow(m_fftw_input, buf, samples);
-	fftw_execute(m_fftw_plan);
-
-	// Count magnitude of each frequency and normalize
-	for (size_t i = 0; i < m_fftw_results; ++i)
-		m_freq_magnitudes[i] = sqrt(
-			m_fftw_output[i][0]*m_fftw_output[i][0]
-		+	m_fftw_output[i][1]*m_fftw_output[i][1]
-		) / (DFT_NONZERO_SIZE);
+	auto &values = m_spectrum_values[flipped];
+	if (m_dft_due || values.size() != m_spectrum_bars.size())
+		ComputeSpectrum(buf, values);
 
-	m_bar_heights.clear();
-
-	const size_t win_width = w.getWidth();
-
-	size_t cur_bin = 0;
-	while (cur_bin < m_fftw_results && Bin2Hz(cur_bin) < m_dft_logspace[0])
-		++cur_bin;
-	for (size_t x = 0; x < win_width; ++x)
+	for (size_t x = 0; x+1 < m_column_weights_offsets.size(); ++x)
 	{
-		double bar_height = 0;
-
-		// accumulate bins
-		size_t count = 0;
-		// check right bound
-		while (cur_bin < m_fftw_results && Bin2Hz(cur_bin) < m_dft_logspace[x])
-		{
-			// check left bound if not first index
-			if (x == 0 || Bin2Hz(cur_bin) >= m_dft_logspace[x-1])
-			{
-				bar_height += m_freq_magnitudes[cur_bin];
-				++count;
-			}
-			++cur_bin;
-		}
-
-		if (count == 0)
-			continue;
-
-		// average bins
-		bar_height /= count;
-
-		// log scale bar heights
-		bar_height = (20 * log10(bar_height) + DYNAMIC_RANGE + GAIN) / DYNAMIC_RANGE;
-		// Scale bar height between 0 and height
-		bar_height = bar_height > 0 ? bar_height * height : 0;
-		bar_height = bar_height > height ? height : bar_height;
-
-		m_bar_heights.emplace_back(x, bar_height);
-	}
-
-	size_t h_idx = 0;
-	for (size_t x = 0; x < win_width; ++x)
-	{
-		const size_t i = m_bar_heights[h_idx].first;
-		const double bar_height = m_bar_heights[h_idx].second;
 		double h = 0;
-
-		if (x == i) {
-			// this data point exists
-			h = bar_height;
-			if (h_idx < m_bar_heights.size()-1)
-				++h_idx;
-		} else {
-			// data point does not exist, need to interpolate
-			h = Interpolate(x, h_idx);
-		}
+		for (size_t k = m_column_weights_offsets[x]; k < m_column_weights_offsets[x+1]; ++k)
+			h += values[m_column_weights[k].bar] * m_column_weights[k].weight;
+		h *= height;
 
 		for (size_t j = 0; j < h; ++j)
 		{
 			size_t y = flipped ? y_offset+j : y_offset+height-j-1;
-			auto color = toColor(j, height, false);
-			std::wstring ch;
+			const auto &color = toColor(j, height, false);
+			wchar_t ch;
+			bool reversed = false;
 	
 			// select character to draw
 			if (Config.visualizer_spectrum_smooth_look) {
@@ -520,7 +423,7 @@ void Visualizer::DrawFrequencySpectrum(const int16_t *buf, ssize_t samples, size
 					// fractional height
 					if (flipped) {
 						ch = SMOOTH_CHARS[size-idx-2];
-						color = NC::FormattedColor(color.color(), {NC::Format::Reverse});
+						reversed = true;
 					} else {
 						ch = SMOOTH_CHARS[idx];
 					}
@@ -531,66 +434,121 @@ void Visualizer::DrawFrequencySpectrum(const int16_t *buf, ssize_t samples, size
 			}
 
 			// draw character on screen
-			w << NC::XY(x, y)
-			  << color
-			  << ch
-			  << NC::FormattedColor::End<>(color);
+			DrawCell(x, y, color, ch, reversed);
 		}
 	}
 }
 
-void Visualizer::DrawFrequencySpectrumStereo(const int16_t *buf_left, const int16_t *buf_right, ssize_t samples, size_t height)
+void Visualizer::DrawFrequencySpectrumStereo(const Samples &buf_left, const Samples &buf_right, size_t height)
 {
-	DrawFrequencySpectrum(buf_left, samples, 0, height);
-	DrawFrequencySpectrum(buf_right, samples, height, w.getHeight() - height);
+	DrawFrequencySpectrum(buf_left, 0, height);
+	DrawFrequencySpectrum(buf_right, height, w.getHeight() - height);
+}
+
+void Visualizer::ComputeSpectrum(const Samples &buf, std::vector<double> &values)
+{
+	values.clear();
+	if (m_spectrum_bars.empty())
+		return;
+
+	if (!m_fft)
+		m_fft = std::make_unique<RealFFT>(
+			DFT_TOTAL_SIZE, Config.ncmpcpp_directory + WISDOM_FILENAME);
+
+	// copy samples to fftw input array and apply Blackman window
+	ApplyWindow(m_fft->input(), buf);
+	m_fft->execute();
+
+	// Only bins that end up in one of the bars are needed.
+	const size_t first_bin = m_spectrum_bars.front().first_bin;
+	const size_t last_bin = m_spectrum_bars.back().last_bin;
+	squaredMagnitudes(m_freq_magnitudes.data() + first_bin,
+	                  m_fft->output() + first_bin,
+	                  last_bin - first_bin);
+
+	const double normalization = 1.0 / DFT_NONZERO_SIZE;
+	for (const auto &bar : m_spectrum_bars)
+	{
+		// average bins
+		double bar_height = 0;
+		for (size_t bin = bar.first_bin; bin < bar.last_bin; ++bin)
+			bar_height += std::sqrt(m_freq_magnitudes[bin]);
+		bar_height *= normalization / (bar.last_bin - bar.first_bin);
+
+		// log scale bar heights
+		bar_height = (20 * log10(bar_height) + DYNAMIC_RANGE + GAIN) / DYNAMIC_RANGE;
+		// Scale bar height between 0 and 1
+		bar_height = bar_height > 0 ? bar_height : 0;
+		bar_height = bar_height > 1 ? 1 : bar_height;
+
+		values.push_back(bar_height);
+	}
 }
 
-double Visualizer::Interpolate(size_t x, size_t h_idx)
+// Heights of columns without their own bar are interpolated from the heights
+// of the neighbouring bars. Interpolation is linear in the heights, so it's
+// done by precomputed weights.
+void Visualizer::GenInterpolationWeights(size_t x, size_t h_idx)
 {
-	const double x_next = m_bar_heights[h_idx].first;
-	const double h_next = m_bar_heights[h_idx].second;
+	auto add_weight = [this](size_t bar, double weight) {
+		m_column_weights.push_back(InterpolationWeight{bar, weight});
+	};
+	auto column = [this](size_t bar) -> double {
+		return m_spectrum_bars[bar].column;
+	};
 
-	double dh = 0;
+	const double x_next = column(h_idx);
 	if (h_idx == 0) {
 		// no data points on left, linear extrap
-		if (h_idx < m_bar_heights.size()-1) {
-			const double x_next2 = m_bar_heights[h_idx+1].first;
-			const double h_next2 = m_bar_heights[h_idx+1].second;
-			dh = (h_next2 - h_next) / (x_next2 - x_next);
+		if (h_idx < m_spectrum_bars.size()-1) {
+			const double x_next2 = column(h_idx+1);
+			const double r = (x_next-x) / (x_next2 - x_next);
+			add_weight(h_idx, 1 + r);
+			add_weight(h_idx+1, -r);
+		} else {
+			add_weight(h_idx, 1);
 		}
-		return h_next - dh*(x_next-x);
 	} else if (h_idx == 1) {
 		// one data point on left, linear interp
-		const double x_prev = m_bar_heights[h_idx-1].first;
-		const double h_prev = m_bar_heights[h_idx-1].second;
-		dh = (h_next - h_prev) / (x_next - x_prev);
-		return h_next - dh*(x_next-x);
-	} else if (h_idx < m_bar_heights.size()-1) {
+		const double x_prev = column(h_idx-1);
+		const double r = (x_next-x) / (x_next - x_prev);
+		add_weight(h_idx-1, r);
+		add_weight(h_idx, 1 - r);
+	} else if (h_idx < m_spectrum_bars.size()-1) {
 		// two data points on both sides, cubic interp
 		// see https://en.wikipedia.org/wiki/Cubic_Hermite_spline#Interpolation_on_an_arbitrary_interval
-		const double x_prev2 = m_bar_heights[h_idx-2].first;
-		const double h_prev2 = m_bar_heights[h_idx-2].second;
-		const double x_prev = m_bar_heights[h_idx-1].first;
-		const double h_prev = m_bar_heights[h_idx-1].second;
-		const double x_next2 = m_bar_heights[h_idx+1].first;
-		const double h_next2 = m_bar_heights[h_idx+1].second;
-
-		const double m0 = (h_prev - h_prev2) / (x_prev - x_prev2);
-		const double m1 = (h_next2 - h_next) / (x_next2 - x_next);
+		const double x_prev2 = column(h_idx-2);
+		const double x_prev = column(h_idx-1);
+		const double x_next2 = column(h_idx+1);
+
 		const double t = (x - x_prev) / (x_next - x_prev);
 		const double h00 = 2*t*t*t - 3*t*t + 1;
 		const double h10 = t*t*t - 2*t*t + t;
 		const double h01 = -2*t*t*t + 3*t*t;
 		const double h11 = t*t*t - t*t;
 
-		return h00*h_prev + h10*(x_next-x_prev)*m0 + h01*h_next + h11*(x_next-x_prev)*m1;
+		// Tangents at both ends are slopes between the outer pairs of bars.
+		const double m0 = h10*(x_next-x_prev) / (x_prev - x_prev2);
+		const double m1 = h11*(x_next-x_prev) / (x_next2 - x_next);
+		add_weight(h_idx-2, -m0);
+		add_weight(h_idx-1, h00 + m0);
+		add_weight(h_idx, h01 - m1);
+		add_weight(h_idx+1, m1);
+	} else {
+		// less than two data points on right, no interp, should never happen
+		// unless VERY low DFT size
+		add_weight(h_idx, 1);
 	}
+}
 
-	// less than two data points on right, no interp, should never happen unless VERY low DFT size
-	return h_next;
+void Visualizer::ApplyWindow(RealFFT::Real *output, const Samples &input)
+{
+	const size_t samples = std::min(input.size(), m_window.size());
+	for (size_t i = 0; i < samples; ++i)
+		output[i] = m_window[i] * input[i];
 }
 
-void Visualizer::ApplyWindow(double *output, const int16_t *input, ssize_t samples)
+void Visualizer::GenWindow()
 {
 	// Use Blackman window for low sidelobes and fast sidelobe rolloff
 	// don't care too much about mainlobe width
@@ -599,10 +557,12 @@ void Visualizer::ApplyWindow(double *output, const int16_t *input, ssize_t sampl
 	const double a1 = 0.5;
 	const double a2 = alpha / 2;
 	const double pi = boost::math::constants::pi<double>();
-	for (unsigned i = 0; i < samples; ++i)
+	m_window.resize(DFT_NONZERO_SIZE);
+	for (size_t i = 0; i < m_window.size(); ++i)
 	{
 		double window = a0 - a1*cos(2*pi*i/(DFT_NONZERO_SIZE-1)) + a2*cos(4*pi*i/(DFT_NONZERO_SIZE-1));
-		output[i] = window * input[i] / INT16_MAX;
+		// Samples are normalized along the way.
+		m_window[i] = window / INT16_MAX;
 	}
 }
 
@@ -623,6 +583,47 @@ void Visualizer::GenLogspace()
 	for (size_t i = left_bins; i < m_dft_logspace.size() + left_bins; ++i) {
 		m_dft_logspace[i - left_bins] = pow(10, i * log_scale);
 	}
+
+	// Assign DFT bins to columns. Each column shows the average of bins with
+	// frequencies between its frequency and the one of the previous column.
+	// Columns without bins don't have their own bars.
+	const size_t results = DFT_TOTAL_SIZE/2+1;
+	m_spectrum_bars.clear();
+	size_t cur_bin = 0;
+	while (cur_bin < results && Bin2Hz(cur_bin) < m_dft_logspace[0])
+		++cur_bin;
+	for (size_t x = 0; x < win_width; ++x)
+	{
+		const size_t first_bin = cur_bin;
+		while (cur_bin < results && Bin2Hz(cur_bin) < m_dft_logspace[x])
+			++cur_bin;
+		if (cur_bin > first_bin)
+			m_spectrum_bars.push_back(SpectrumBar{x, first_bin, cur_bin});
+	}
+
+	m_column_weights.clear();
+	m_column_weights_offsets.clear();
+	size_t h_idx = 0;
+	for (size_t x = 0; x < win_width; ++x)
+	{
+		m_column_weights_offsets.push_back(m_column_weights.size());
+		if (m_spectrum_bars.empty())
+			continue;
+		if (x == m_spectrum_bars[h_idx].column) {
+			// this data point exists
+			m_column_weights.push_back(InterpolationWeight{h_idx, 1});
+			if (h_idx < m_spectrum_bars.size()-1)
+				++h_idx;
+		} else {
+			// data point does not exist, need to interpolate
+			GenInterpolationWeights(x, h_idx);
+		}
+	}
+	m_column_weights_offsets.push_back(m_column_weights.size());
+
+	// Bars changed, so their heights need to be recomputed.
+	m_spectrum_values[0].clear();
+	m_spectrum_values[1].clear();
 }
 #endif // HAVE_FFTW3_H
 
@@ -647,6 +648,9 @@ void Visualizer::InitDataSource()
 
 void Visualizer::InitVisualization()
 {
+	const bool rendering = m_frame_renderer.joinable();
+	StopFrameRenderer();
+
 	size_t rendered_samples = 0;
 	switch (Config.visualizer_type)
 	{
@@ -684,14 +688,19 @@ void Visualizer::InitVisualization()
 	}
 	if (Config.visualizer_in_stereo)
 		rendered_samples *= 2;
-	m_rendered_samples.resize(rendered_samples);
 
-	// Keep 500ms worth of samples in the incoming buffer.
-	size_t buffered_samples = 44100.0 / 2;
-	if (Config.visualizer_in_stereo)
-		buffered_samples *= 2;
-	m_incoming_samples.resize(buffered_samples);
-	m_buffered_samples.resize(buffered_samples);
+	// The buffer can't be resized while samples are being put into it.
+	bool reading = m_source_reader.joinable();
+	if (reading)
+		StopSourceReader();
+	// Keep 500ms worth of samples in the buffer. Rendered samples are the most
+	// recently consumed ones.
+	m_buffered_samples.resize(bufferedSamples(), rendered_samples);
+	if (reading)
+		StartSourceReader();
+
+	if (rendering)
+		StartFrameRenderer();
 }
 
 /**********************************************************************/
@@ -699,18 +708,12 @@ void Visualizer::InitVisualization()
 void Visualizer::Clear()
 {
 	w.clear();
-	std::fill(m_rendered_samples.begin(), m_rendered_samples.end(), 0);
-
-	// Discard any lingering data from the data source.
-	if (m_source_fd >= 0)
-	{
-		ssize_t bytes_read;
-		do
-			bytes_read = read(m_source_fd, m_incoming_samples.data(),
-			                  sizeof(int16_t) * m_incoming_samples.size());
-		while (bytes_read > 0);
-	}
-
+	// Samples can't be discarded while a frame is being rendered.
+	const bool rendering = m_frame_renderer.joinable();
+	StopFrameRenderer();
+	m_buffered_samples.clear();
+	if (rendering)
+		StartFrameRenderer();
 }
 
 void Visualizer::ToggleVisualizationType()
@@ -797,34 +800,260 @@ void Visualizer::OpenDataSource()
 
 void Visualizer::CloseDataSource()
 {
+	Suspend();
 	if (m_source_fd >= 0)
 		close(m_source_fd);
 	m_source_fd = -1;
 }
 
-void Visualizer::FindOutputID()
+void Visualizer::Resume()
 {
-	m_output_id = -1;
-	// Look for the output only if its name is specified and we're fetching
-	// samples from a FIFO.
-	if (!Config.visualizer_output_name.empty() && m_source_port.empty())
+	if (m_source_fd < 0)
+		return;
+	if (!m_source_reader.joinable())
+		StartSourceReader();
+	if (!m_frame_renderer.joinable())
+		StartFrameRenderer();
+}
+
+void Visualizer::Suspend()
+{
+	StopFrameRenderer();
+	StopSourceReader();
+}
+
+void Visualizer::ResetAutoScaleMultiplier()
+{
+	m_reset_auto_scale = true;
+}
+
+size_t Visualizer::bufferedSamples() const
+{
+	size_t result = 44100.0 / 2;
+	if (Config.visualizer_in_stereo)
+		result *= 2;
+	return result;
+}
+
+void Visualizer::StartSourceReader()
+{
+	assert(!m_source_reader.joinable());
+	if (pipe(m_source_reader_pipe) != 0)
+	{
+		Statusbar::printf("Couldn't start reading PCM data: %1%", strerror(errno));
+		return;
+	}
+	m_source_reader = std::thread(&Visualizer::ReadSource, this);
+}
+
+void Visualizer::StopSourceReader()
+{
+	if (!m_source_reader.joinable())
+		return;
+	// Wake up the reader, it exits when the pipe becomes readable.
+	char c = 0;
+	while (write(m_source_reader_pipe[1], &c, 1) < 0 && errno == EINTR)
+		;
+	m_source_reader.join();
+	close(m_source_reader_pipe[0]);
+	close(m_source_reader_pipe[1]);
+}
+
+void Visualizer::ReadSource()
+{
+	// PCM in format 44100:16:1 (for mono visualization) and
+	// 44100:16:2 (for stereo visualization) is supported.
+	const size_t channels = Config.visualizer_in_stereo ? 2 : 1;
+	const size_t frame_size = sizeof(int16_t) * channels;
+	const double sample_rate = 44100.0 * channels;
+
+	std::vector<int16_t> incoming(bufferedSamples());
+	char *data = reinterpret_cast<char *>(incoming.data());
+	const size_t data_size = sizeof(int16_t) * incoming.size();
+	// Number of bytes of an incomplete frame left from the previous read.
+	size_t partial_frame = 0;
+
+	auto previous_block_time = std::chrono::steady_clock::now();
+	pollfd fds[] = {
+		{ m_source_reader_pipe[0], POLLIN, 0 },
+		{ m_source_fd, POLLIN, 0 }
+	};
+	while (true)
 	{
-		for (MPD::OutputIterator out = Mpd.GetOutputs(), end; out != end; ++out)
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[0].revents != 0)
+			break;
+
+		ssize_t bytes_read = -1;
+		if (fds[1].revents & POLLIN)
+			bytes_read = read(m_source_fd, data + partial_frame,
+			                  data_size - partial_frame);
+		if (bytes_read <= 0)
 		{
-			if (out->name() == Config.visualizer_output_name)
+			// Most likely the writer of the FIFO went away. Until it comes back
+			// the FIFO is reported as hung up, so check it only from time to
+			// time then.
+			if (bytes_read == 0 || (fds[1].revents & (POLLHUP | POLLERR | POLLNVAL)))
 			{
-				m_output_id = out->id();
-				break;
+				if (poll(fds, 1, 100) != 0)
+					break;
+			}
+			continue;
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		const size_t bytes = partial_frame + bytes_read;
+		const auto begin = incoming.data();
+		const auto end = begin + bytes / frame_size * channels;
+
+		if (m_reset_auto_scale.exchange(false))
+			m_auto_scale_multiplier = 1;
+		if (Config.visualizer_autoscale)
+		{
+			m_auto_scale_multiplier += (end - begin) / sample_rate;
+			// Don't let the loudest sample exceed the range.
+			int32_t peak = peakAmplitude(begin, end - begin);
+			if (peak > 0)
+			{
+				double scale = -double(std::numeric_limits<int16_t>::min()) / peak;
+				m_auto_scale_multiplier = std::min(m_auto_scale_multiplier, scale);
 			}
+			if (m_auto_scale_multiplier <= 50.0) // limit the auto scale
+				scaleSamples(begin, end - begin, m_auto_scale_multiplier);
+		}
+		m_buffered_samples.put(begin, end);
+
+		partial_frame = bytes % frame_size;
+		std::memmove(data, data + bytes - partial_frame, partial_frame);
+
+		// Keep track of the usual interval between blocks, ignoring pauses.
+		std::chrono::duration<double> interval = now - previous_block_time;
+		previous_block_time = now;
+		{
+			std::lock_guard<std::mutex> lock(m_block_mutex);
+			m_last_block_time = now;
+			if (interval.count() < 0.5)
+				m_block_interval = 0.9*m_block_interval + 0.1*interval.count();
 		}
-		if (m_output_id == -1)
-			Statusbar::printf("There is no output named \"%s\"", Config.visualizer_output_name);
 	}
 }
 
-void Visualizer::ResetAutoScaleMultiplier()
+void Visualizer::DrawCell(size_t x, size_t y, const NC::FormattedColor &color,
+                          wchar_t ch, bool reversed)
+{
+	m_back_frame.push_back(Cell{uint16_t(x), uint16_t(y), ch, reversed, &color});
+}
+
+void Visualizer::StartFrameRenderer()
+{
+	assert(!m_frame_renderer.joinable());
+	m_stop_frame_renderer = false;
+	m_frame_renderer = std::thread(&Visualizer::RenderFrames, this);
+}
+
+void Visualizer::StopFrameRenderer()
+{
+	if (!m_frame_renderer.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_frame_mutex);
+		m_stop_frame_renderer = true;
+		// The frame may no longer match the window.
+		m_frame_ready = false;
+	}
+	m_frame_cv.notify_one();
+	m_frame_renderer.join();
+}
+
+void Visualizer::RenderFrames()
+{
+	const auto interval = std::chrono::microseconds(1000000 / Config.visualizer_fps);
+	auto next_frame = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(m_frame_mutex);
+	while (true)
+	{
+		// Don't try to catch up if rendering took too long.
+		next_frame = std::max(next_frame + interval, std::chrono::steady_clock::now());
+		m_frame_cv.wait_until(lock, next_frame, [this] {
+			return m_stop_frame_renderer;
+		});
+		if (m_stop_frame_renderer)
+			break;
+		// If the previous frame wasn't drawn yet, the screen is most likely not
+		// visible, so there is no point in rendering a new one.
+		if (m_frame_ready)
+			continue;
+
+		lock.unlock();
+		bool rendered = RenderFrame();
+		lock.lock();
+		if (rendered)
+		{
+			m_frame.swap(m_back_frame);
+			m_frame_ready = true;
+		}
+	}
+}
+
+bool Visualizer::RenderFrame()
 {
-	m_auto_scale_multiplier = 1;
+	const size_t channels = Config.visualizer_in_stereo ? 2 : 1;
+
+	// Samples arrive in blocks, consume them up to the point corresponding to
+	// the current time, lagging behind by the usual interval between blocks, so
+	// that each frame shows samples from its own time window.
+	double lag;
+	{
+		std::lock_guard<std::mutex> lock(m_block_mutex);
+		std::chrono::duration<double> since_last_block =
+			std::chrono::steady_clock::now() - m_last_block_time;
+		lag = std::max(0.0, m_block_interval - since_last_block.count());
+	}
+	size_t lagging_samples = lag * 44100 * channels;
+	size_t available_samples = m_buffered_samples.size();
+	if (available_samples <= lagging_samples)
+		return false;
+
+	// Consume whole frames, so that channels stay in place.
+	size_t requested_samples = available_samples - lagging_samples;
+	requested_samples -= requested_samples % channels;
+	size_t new_samples = m_buffered_samples.get(requested_samples);
+	if (new_samples == 0)
+		return false;
+
+#	ifdef HAVE_FFTW3_H
+	// The spectrum is recomputed once DFT_HOP new samples arrived, its window
+	// overlaps the previous one by the rest of the samples.
+	m_samples_since_dft += new_samples / channels;
+	if (m_samples_since_dft >= DFT_HOP)
+	{
+		m_samples_since_dft = DFT_HOP > 0 ? m_samples_since_dft % DFT_HOP : 0;
+		m_dft_due = true;
+	}
+#	endif // HAVE_FFTW3_H
+
+	m_back_frame.clear();
+	if (Config.visualizer_in_stereo)
+	{
+		// Channels are interleaved, so they're accessed with a stride.
+		size_t half_height = w.getHeight()/2;
+		(this->*drawStereo)(m_buffered_samples.history(0, 2),
+		                    m_buffered_samples.history(1, 2),
+		                    half_height);
+	}
+	else
+	{
+		(this->*draw)(m_buffered_samples.history(), 0, w.getHeight());
+	}
+#	ifdef HAVE_FFTW3_H
+	m_dft_due = false;
+#	endif // HAVE_FFTW3_H
+	return true;
 }
 
 #endif // ENABLE_VISUALIZER
@@ -25,16 +25,19 @@
 
 #ifdef ENABLE_VISUALIZER
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include "curses/window.h"
 #include "interfaces.h"
 #include "screens/screen.h"
+#include "utility/fft.h"
 #include "utility/sample_buffer.h"
 
-#ifdef HAVE_FFTW3_H
-# include <fftw3.h>
-#endif
-
 
 struct Visualizer: Screen<NC::Window>, Tabbable
 {
@@ -60,63 +63,143 @@ struct Visualizer: Screen<NC::Window>, Tabbable
 	void OpenDataSource();
 	void CloseDataSource();
 
+	// Samples are read from the data source and frames are rendered only
+	// while the visualizer is visible.
+	void Resume();
+	void Suspend();
+
 	void ToggleVisualizationType();
-	void FindOutputID();
 	void ResetAutoScaleMultiplier();
 
 private:
-	void DrawSoundWave(const int16_t *, ssize_t, size_t, size_t);
-	void DrawSoundWaveStereo(const int16_t *, const int16_t *, ssize_t, size_t);
-	void DrawSoundWaveFill(const int16_t *, ssize_t, size_t, size_t);
-	void DrawSoundWaveFillStereo(const int16_t *, const int16_t *, ssize_t, size_t);
-	void DrawSoundEllipse(const int16_t *, ssize_t, size_t, size_t);
-	void DrawSoundEllipseStereo(const int16_t *, const int16_t *, ssize_t, size_t);
+	typedef SampleBuffer::View Samples;
+
+	// Character of a frame along with its position and color.
+	struct Cell
+	{
+		uint16_t x;
+		uint16_t y;
+		wchar_t ch;
+		bool reversed;
+		const NC::FormattedColor *color;
+	};
+	typedef std::vector<Cell> Frame;
+
+	void DrawCell(size_t x, size_t y, const NC::FormattedColor &color, wchar_t ch,
+	              bool reversed = false);
+
+	void DrawSoundWave(const Samples &, size_t, size_t);
+	void DrawSoundWaveStereo(const Samples &, const Samples &, size_t);
+	void DrawSoundWaveFill(const Samples &, size_t, size_t);
+	void DrawSoundWaveFillStereo(const Samples &, const Samples &, size_t);
+	void DrawSoundEllipse(const Samples &, size_t, size_t);
+	void DrawSoundEllipseStereo(const Samples &, const Samples &, size_t);
 #	ifdef HAVE_FFTW3_H
-	void DrawFrequencySpectrum(const int16_t *, ssize_t, size_t, size_t);
-	void DrawFrequencySpectrumStereo(const int16_t *, const int16_t *, ssize_t, size_t);
-	void ApplyWindow(double *, const int16_t *, ssize_t);
+	void DrawFrequencySpectrum(const Samples &, size_t, size_t);
+	void DrawFrequencySpectrumStereo(const Samples &, const Samples &, size_t);
+	void ComputeSpectrum(const Samples &, std::vector<double> &);
+	void ApplyWindow(RealFFT::Real *, const Samples &);
+	void GenWindow();
 	void GenLogspace();
+	void GenInterpolationWeights(size_t, size_t);
 	double Bin2Hz(size_t);
-	double Interpolate(size_t, size_t);
 #	endif // HAVE_FFTW3_H
 
 	void InitDataSource();
 	void InitVisualization();
 
-	void (Visualizer::*draw)(const int16_t *, ssize_t, size_t, size_t);
-	void (Visualizer::*drawStereo)(const int16_t *, const int16_t *, ssize_t, size_t);
+	size_t bufferedSamples() const;
+
+	// Samples are read from the data source in a separate thread as soon as
+	// they arrive and put into m_buffered_samples.
+	void StartSourceReader();
+	void StopSourceReader();
+	void ReadSource();
 
-	int m_output_id;
-	bool m_reset_output;
+	// Frames are computed in a separate thread at the configured fps, the UI
+	// thread only draws the most recent complete one.
+	void StartFrameRenderer();
+	void StopFrameRenderer();
+	void RenderFrames();
+	bool RenderFrame();
+
+	void (Visualizer::*draw)(const Samples &, size_t, size_t);
+	void (Visualizer::*drawStereo)(const Samples &, const Samples &, size_t);
 
 	int m_source_fd;
 	std::string m_source_location;
 	std::string m_source_port;
 
-	std::vector<int16_t> m_rendered_samples;
-	std::vector<int16_t> m_incoming_samples;
+	std::thread m_source_reader;
+	int m_source_reader_pipe[2];
+
 	SampleBuffer m_buffered_samples;
-	size_t m_sample_consumption_rate;
-	size_t m_sample_consumption_rate_up_ctr;
-	size_t m_sample_consumption_rate_dn_ctr;
 
+	// Arrival time of the most recent block of samples and average interval
+	// between blocks (in seconds).
+	std::mutex m_block_mutex;
+	std::chrono::steady_clock::time_point m_last_block_time;
+	double m_block_interval;
+
+	std::thread m_frame_renderer;
+	std::mutex m_frame_mutex;
+	std::condition_variable m_frame_cv;
+	bool m_stop_frame_renderer;
+	// Frame ready to be drawn, guarded by m_frame_mutex.
+	Frame m_frame;
+	bool m_frame_ready;
+	// Frame being computed, used only by the renderer thread.
+	Frame m_back_frame;
+
+	std::atomic<bool> m_reset_auto_scale;
+	// Used only by the reader thread.
 	double m_auto_scale_multiplier;
 #	ifdef HAVE_FFTW3_H
-	size_t m_fftw_results;
-	double *m_fftw_input;
-	fftw_complex *m_fftw_output;
-	fftw_plan m_fftw_plan;
+	// Created when the spectrum is drawn for the first time, as measuring the
+	// plan may take a while.
+	std::unique_ptr<RealFFT> m_fft;
 	const uint32_t DFT_NONZERO_SIZE;
 	const uint32_t DFT_TOTAL_SIZE;
+	// Number of new samples after which the spectrum is recomputed.
+	const uint32_t DFT_HOP;
 	const double DYNAMIC_RANGE;
 	const double HZ_MIN;
 	const double HZ_MAX;
 	const double GAIN;
 	const std::wstring SMOOTH_CHARS;
 	std::vector<double> m_dft_logspace;
-	std::vector<std::pair<size_t, double>> m_bar_heights;
+
+	// Column of the screen that shows a bar and the range of DFT bins it
+	// averages.
+	struct SpectrumBar
+	{
+		size_t column;
+		size_t first_bin;
+		size_t last_bin;
+	};
+	std::vector<SpectrumBar> m_spectrum_bars;
+
+	// Heights of columns are weighted sums of heights of bars, weights of column
+	// x are in the range [m_column_weights_offsets[x],
+	// m_column_weights_offsets[x+1]).
+	struct InterpolationWeight
+	{
+		size_t bar;
+		double weight;
+	};
+	std::vector<InterpolationWeight> m_column_weights;
+	std::vector<size_t> m_column_weights_offsets;
+
+	// Heights of bars between 0 and 1 for each channel. The spectrum is
+	// computed from the most recent DFT_NONZERO_SIZE samples once DFT_HOP new
+	// samples arrived, otherwise the previous heights are drawn.
+	std::vector<double> m_spectrum_values[2];
+	size_t m_samples_since_dft;
+	bool m_dft_due;
 
 	std::vector<double> m_freq_magnitudes;
+	// Window function applied to the input of DFT.
+	std::vector<RealFFT::Real> m_window;
 #	endif // HAVE_FFTW3_H
 };
 
@@ -229,9 +229,19 @@ bool Configuration::read(const std::vector<std::string> &config_paths, bool igno
 	p.add("mpd_music_dir", &mpd_music_dir, "~/music", adjust_directory);
 	p.add("mpd_connection_timeout", &mpd_connection_timeout, "5");
 	p.add("mpd_crossfade_time", &crossfade_time, "5");
-	p.add("random_exclude_pattern", &random_exclude_pattern, "");
+	p.add("random_exclude_pattern", &random_exclude_pattern, "", [](std::string v) {
+			// Compile the pattern once, it's matched against every song path.
+			if (v.empty())
+				return boost::regex();
+			else
+				return boost::regex(v);
+		});
 	p.add("visualizer_data_source", &visualizer_data_source, "/tmp/mpd.fifo", adjust_path);
-	p.add("visualizer_output_name", &visualizer_output_name, "Visualizer feed");
+	p.add<void>("visualizer_output_name", nullptr, "", [](std::string v) {
+			if (!v.empty())
+				deprecated("visualizer_output_name", "0.11",
+				           "it's no longer needed to synchronize the visualizer");
+		});
 	p.add("visualizer_in_stereo", &visualizer_in_stereo, "yes", yes_no);
 	p.add("visualizer_type", &visualizer_type,
 #ifdef HAVE_FFTW3_H
@@ -259,6 +269,12 @@ bool Configuration::read(const std::vector<std::string> &config_paths, bool igno
 			boundsCheck<size_t>(result, 1, 5);
 			return result;
 			});
+	p.add("visualizer_spectrum_rate", &visualizer_spectrum_rate,
+			"0", [](std::string v) {
+			uint32_t result = verbose_lexical_cast<uint32_t>(v);
+			boundsCheck<uint32_t>(result, 0, 1000);
+			return result;
+			});
 	p.add("visualizer_spectrum_gain", &visualizer_spectrum_gain,
 			"10", [](std::string v) {
 			auto result = verbose_lexical_cast<double>(v);
@@ -464,6 +480,7 @@ bool Configuration::read(const std::vector<std::string> &config_paths, bool igno
 	p.add("follow_now_playing_lyrics", &now_playing_lyrics, "no", yes_no);
 	p.add("fetch_lyrics_for_current_song_in_background", &fetch_lyrics_in_background,
 	      "no", yes_no);
+	p.add("fetch_lyrics_concurrently", &fetch_lyrics_concurrently, "no", yes_no);
 	p.add("store_lyrics_in_song_dir", &store_lyrics_in_song_dir, "no", yes_no);
 	p.add("generate_win32_compatible_filenames", &generate_win32_compatible_filenames,
 	      "yes", yes_no);
@@ -552,6 +569,8 @@ bool Configuration::read(const std::vector<std::string> &config_paths, bool igno
 	p.add("tags_separator", &MPD::Song::TagsSeparator, " | ");
 	p.add("tag_editor_extended_numeration", &tag_editor_extended_numeration, "no", yes_no);
 	p.add("media_library_sort_by_mtime", &media_library_sort_by_mtime, "no", yes_no);
+	p.add("media_library_incremental_update", &media_library_incremental_update, "no", yes_no);
+	p.add("database_cache", &database_cache, "no", yes_no);
 	p.add("enable_window_title", &set_window_title, "yes", [](std::string v) {
 			// Consider this variable only if TERM variable is available and we're not
 			// in emacs terminal nor tty (through any wrapper like screen).
@@ -63,7 +63,6 @@ struct Configuration
 	std::string mpd_music_dir;
 	std::string visualizer_fifo_path; // deprecated
 	std::string visualizer_data_source;
-	std::string visualizer_output_name;
 	std::string empty_tag;
 
 	Format::AST<char> song_list_format;
@@ -87,6 +86,7 @@ struct Configuration
 	bool visualizer_autoscale;
 	bool visualizer_spectrum_smooth_look;
 	uint32_t visualizer_spectrum_dft_size;
+	uint32_t visualizer_spectrum_rate;
 	double visualizer_spectrum_gain;
 	double visualizer_spectrum_hz_min;
 	double visualizer_spectrum_hz_max;
@@ -161,6 +161,7 @@ struct Configuration
 	bool incremental_seeking;
 	bool now_playing_lyrics;
 	bool fetch_lyrics_in_background;
+	bool fetch_lyrics_concurrently;
 	bool local_browser_show_hidden_files;
 	bool search_in_db;
 	bool jump_to_now_playing_song_at_start;
@@ -180,6 +181,8 @@ struct Configuration
 	bool visualizer_in_stereo;
 	bool data_fetching_delay;
 	bool media_library_sort_by_mtime;
+	bool media_library_incremental_update;
+	bool database_cache;
 	bool media_lib_hide_album_dates;
 	bool tag_editor_extended_numeration;
 	bool discard_colors_if_item_is_selected;
@@ -218,7 +221,7 @@ struct Configuration
 	boost::optional<ScreenType> startup_slave_screen_type;
 	std::vector<ScreenType> screen_sequence;
 
-	std::string random_exclude_pattern;
+	boost::regex random_exclude_pattern;
 	SortMode browser_sort_mode;
 
 	LyricsFetchers lyrics_fetchers;
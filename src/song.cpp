@@ -42,6 +42,19 @@ void format_numeric_tag(std::string &s)
 		s = "0"+s;
 }
 
+boost::string_ref format_numeric_tag(boost::string_ref s, std::string &buffer)
+{
+	if ((s.length() == 1 && s[0] != '0')
+	    || (s.length() > 3 && s[1] == '/'))
+	{
+		buffer.assign(1, '0');
+		buffer.append(s.data(), s.size());
+		return buffer;
+	}
+	else
+		return s;
+}
+
 size_t calc_hash(const char *s, size_t seed = 0)
 {
 	for (; *s != '\0'; ++s)
@@ -253,6 +266,228 @@ std::string MPD::Song::getTags(GetFunction f) const
 	return result;
 }
 
+boost::string_ref Song::peek(mpd_tag_type type, unsigned idx) const
+{
+	const char *tag = mpd_song_get_tag(m_song.get(), type, idx);
+	if (tag)
+		return tag;
+	else
+		return boost::string_ref();
+}
+
+boost::string_ref Song::peekURI(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	if (idx > 0)
+		return boost::string_ref();
+	else
+		return mpd_song_get_uri(m_song.get());
+}
+
+boost::string_ref Song::peekName(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	mpd_song *s = m_song.get();
+	const char *res = mpd_song_get_tag(s, MPD_TAG_NAME, idx);
+	if (res)
+		return res;
+	else if (idx > 0)
+		return boost::string_ref();
+	const char *uri = mpd_song_get_uri(s);
+	const char *name = strrchr(uri, '/');
+	if (name)
+		return name+1;
+	else
+		return uri;
+}
+
+boost::string_ref Song::peekDirectory(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	if (idx > 0 || isStream())
+		return boost::string_ref();
+	const char *uri = mpd_song_get_uri(m_song.get());
+	const char *name = strrchr(uri, '/');
+	if (name)
+		return boost::string_ref(uri, name-uri);
+	else
+		return "/";
+}
+
+boost::string_ref Song::peekArtist(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_ARTIST, idx);
+}
+
+boost::string_ref Song::peekTitle(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_TITLE, idx);
+}
+
+boost::string_ref Song::peekAlbum(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_ALBUM, idx);
+}
+
+boost::string_ref Song::peekAlbumArtist(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_ALBUM_ARTIST, idx);
+}
+
+boost::string_ref Song::peekTrack(unsigned idx, std::string &buffer) const
+{
+	assert(m_song);
+	return format_numeric_tag(peek(MPD_TAG_TRACK, idx), buffer);
+}
+
+boost::string_ref Song::peekTrackNumber(unsigned idx, std::string &buffer) const
+{
+	assert(m_song);
+	boost::string_ref track = peekTrack(idx, buffer);
+	size_t slash = track.find('/');
+	if (slash != boost::string_ref::npos)
+		track = track.substr(0, slash);
+	return track;
+}
+
+boost::string_ref Song::peekDate(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_DATE, idx);
+}
+
+boost::string_ref Song::peekGenre(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_GENRE, idx);
+}
+
+boost::string_ref Song::peekComposer(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_COMPOSER, idx);
+}
+
+boost::string_ref Song::peekPerformer(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_PERFORMER, idx);
+}
+
+boost::string_ref Song::peekDisc(unsigned idx, std::string &buffer) const
+{
+	assert(m_song);
+	return format_numeric_tag(peek(MPD_TAG_DISC, idx), buffer);
+}
+
+boost::string_ref Song::peekComment(unsigned idx, std::string &) const
+{
+	assert(m_song);
+	return peek(MPD_TAG_COMMENT, idx);
+}
+
+boost::string_ref Song::peekLength(unsigned idx, std::string &buffer) const
+{
+	assert(m_song);
+	if (idx > 0)
+		return boost::string_ref();
+	unsigned len = getDuration();
+	if (len > 0)
+	{
+		buffer = ShowTime(len);
+		return buffer;
+	}
+	else
+		return "-:--";
+}
+
+boost::string_ref Song::peekPriority(unsigned idx, std::string &buffer) const
+{
+	assert(m_song);
+	if (idx > 0)
+		return boost::string_ref();
+	buffer = boost::lexical_cast<std::string>(getPrio());
+	return buffer;
+}
+
+boost::string_ref Song::peekTags(PeekFunction f, std::string &buffer) const
+{
+	assert(m_song);
+	// The vast majority of tags have a single value, return it as it is.
+	std::string tag_buffer;
+	boost::string_ref tag = (this->*f)(0, buffer);
+	if (tag.empty() || (this->*f)(1, tag_buffer).empty())
+		return tag;
+
+	unsigned idx = 0;
+	std::string result;
+	if (ShowDuplicateTags)
+	{
+		for (; !(tag = (this->*f)(idx, tag_buffer)).empty(); ++idx)
+		{
+			if (!result.empty())
+				result += TagsSeparator;
+			result.append(tag.data(), tag.size());
+		}
+	}
+	else
+	{
+		bool already_present;
+		std::string other_buffer;
+		for (; !(tag = (this->*f)(idx, tag_buffer)).empty(); ++idx)
+		{
+			already_present = false;
+			for (unsigned i = 0; i < idx; ++i)
+			{
+				if ((this->*f)(i, other_buffer) == tag)
+				{
+					already_present = true;
+					break;
+				}
+			}
+			if (!already_present)
+			{
+				if (idx > 0)
+					result += TagsSeparator;
+				result.append(tag.data(), tag.size());
+			}
+		}
+	}
+	buffer = std::move(result);
+	return buffer;
+}
+
+Song::PeekFunction Song::peekFunction(GetFunction f)
+{
+	static const std::pair<GetFunction, PeekFunction> functions[] = {
+		{ &Song::getURI, &Song::peekURI },
+		{ &Song::getName, &Song::peekName },
+		{ &Song::getDirectory, &Song::peekDirectory },
+		{ &Song::getArtist, &Song::peekArtist },
+		{ &Song::getTitle, &Song::peekTitle },
+		{ &Song::getAlbum, &Song::peekAlbum },
+		{ &Song::getAlbumArtist, &Song::peekAlbumArtist },
+		{ &Song::getTrack, &Song::peekTrack },
+		{ &Song::getTrackNumber, &Song::peekTrackNumber },
+		{ &Song::getDate, &Song::peekDate },
+		{ &Song::getGenre, &Song::peekGenre },
+		{ &Song::getComposer, &Song::peekComposer },
+		{ &Song::getPerformer, &Song::peekPerformer },
+		{ &Song::getDisc, &Song::peekDisc },
+		{ &Song::getComment, &Song::peekComment },
+		{ &Song::getLength, &Song::peekLength },
+		{ &Song::getPriority, &Song::peekPriority },
+	};
+	for (const auto &function : functions)
+		if (function.first == f)
+			return function.second;
+	return nullptr;
+}
+
 unsigned Song::getDuration() const
 {
 	assert(m_song);
@@ -271,6 +506,14 @@ unsigned Song::getID() const
 	return mpd_song_get_id(m_song.get());
 }
 
+void Song::setPosition(unsigned pos)
+{
+	assert(m_song);
+	if (m_song.use_count() > 1)
+		m_song = std::shared_ptr<mpd_song>(mpd_song_dup(m_song.get()), mpd_song_free);
+	mpd_song_set_pos(m_song.get(), pos);
+}
+
 unsigned Song::getPrio() const
 {
 	assert(m_song);
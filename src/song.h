@@ -26,6 +26,7 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <boost/utility/string_ref.hpp>
 
 #include <mpd/client.h>
 
@@ -38,6 +39,7 @@ struct Song
 	};
 
 	typedef std::string (Song::*GetFunction)(unsigned) const;
+	typedef boost::string_ref (Song::*PeekFunction)(unsigned, std::string &) const;
 	
 	Song() : m_hash(0) { }
 	virtual ~Song() { }
@@ -74,12 +76,44 @@ struct Song
 	virtual std::string getPriority(unsigned idx = 0) const;
 	
 	virtual std::string getTags(GetFunction f) const;
+
+	// Non-allocating counterparts of the above accessors. Returned value points
+	// either to the data of the song or, if it needs to be computed, to buffer.
+	// It's valid as long as both of them are alive and unchanged.
+	boost::string_ref peek(mpd_tag_type type, unsigned idx = 0) const;
+
+	virtual boost::string_ref peekURI(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekName(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekDirectory(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekArtist(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekTitle(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekAlbum(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekAlbumArtist(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekTrack(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekTrackNumber(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekDate(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekGenre(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekComposer(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekPerformer(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekDisc(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekComment(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekLength(unsigned idx, std::string &buffer) const;
+	virtual boost::string_ref peekPriority(unsigned idx, std::string &buffer) const;
+
+	boost::string_ref peekTags(PeekFunction f, std::string &buffer) const;
+
+	// Non-allocating counterpart of a given accessor or nullptr if there is none.
+	static PeekFunction peekFunction(GetFunction f);
 	
 	virtual unsigned getDuration() const;
 	virtual unsigned getPosition() const;
 	virtual unsigned getID() const;
 	virtual unsigned getPrio() const;
 	virtual time_t getMTime() const;
+
+	// Set position of the song in the playlist. Underlying song is copied
+	// first if it's shared with other instances.
+	void setPosition(unsigned pos);
 	
 	virtual bool isFromDatabase() const;
 	virtual bool isStream() const;
@@ -99,6 +133,10 @@ struct Song
 
 	const char *c_uri() const { return m_song ? mpd_song_get_uri(m_song.get()) : ""; }
 
+	// Underlying song. As it's never modified in place when shared, it can be
+	// used to tell whether the data of the song changed while a copy is kept.
+	const mpd_song *c_song() const { return m_song.get(); }
+
 	static std::string ShowTime(unsigned length);
 
 	static std::string TagsSeparator;
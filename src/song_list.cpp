@@ -52,6 +52,16 @@ ConstSongIterator SongMenu::endS() const
 	return makeConstSongIterator(end());
 }
 
+const MPD::Song *SongMenu::songAt(size_t pos) const
+{
+	return menuSongAt(*this, pos);
+}
+
+const MPD::Song *SongMenu::currentSong() const
+{
+	return menuCurrentSong(*this);
+}
+
 std::vector<MPD::Song> SongMenu::getSelectedSongs()
 {
 	std::vector<MPD::Song> result;
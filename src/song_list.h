@@ -111,6 +111,12 @@ struct SongList
 	virtual SongIterator endS() = 0;
 	virtual ConstSongIterator endS() const = 0;
 
+	// Song at a given position or nullptr if the item there is not a song.
+	// Unlike iterators above, it doesn't go through type erasure.
+	virtual const MPD::Song *songAt(size_t pos) const = 0;
+	// Highlighted song or nullptr if there is none.
+	virtual const MPD::Song *currentSong() const = 0;
+
 	virtual std::vector<MPD::Song> getSelectedSongs() = 0;
 };
 
@@ -132,6 +138,9 @@ struct SongMenu: NC::Menu<MPD::Song>, SongList
 	virtual SongIterator endS() override;
 	virtual ConstSongIterator endS() const override;
 
+	virtual const MPD::Song *songAt(size_t pos) const override;
+	virtual const MPD::Song *currentSong() const override;
+
 	virtual std::vector<MPD::Song> getSelectedSongs() override;
 };
 
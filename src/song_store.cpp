@@ -0,0 +1,79 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#include <boost/functional/hash.hpp>
+#include <cassert>
+#include <limits>
+
+#include "song_store.h"
+
+namespace MPD {
+
+size_t StringPool::Hash::operator()(Id id) const
+{
+	auto s = m_pool.get(id);
+	return boost::hash_range(s.begin(), s.end());
+}
+
+StringPool::StringPool()
+: m_offsets(1, 0)
+, m_index(0, Hash(*this), Equal(*this))
+{ }
+
+StringPool::Id StringPool::intern(boost::string_ref s)
+{
+	assert(m_data.size() + s.size() <= std::numeric_limits<uint32_t>::max());
+	// Append the string tentatively so that it can be looked up by its id and
+	// remove it if it's already there.
+	Id id = size();
+	m_data.insert(m_data.end(), s.begin(), s.end());
+	m_offsets.push_back(m_data.size());
+	auto it = m_index.insert(id);
+	if (!it.second)
+	{
+		m_offsets.pop_back();
+		m_data.resize(m_offsets.back());
+	}
+	return *it.first;
+}
+
+SongStore::SongStore(Fields fields)
+: m_fields(std::move(fields))
+, m_columns(m_fields.size())
+, m_size(0)
+{
+	for (auto f : m_fields)
+		m_peek_functions.push_back(Song::peekFunction(f));
+}
+
+void SongStore::add(const Song &s)
+{
+	for (size_t i = 0; i < m_fields.size(); ++i)
+	{
+		if (m_peek_functions[i] != nullptr)
+			m_columns[i].push_back(m_strings.intern(
+				s.peekTags(m_peek_functions[i], m_buffer)));
+		else
+			m_columns[i].push_back(m_strings.intern(s.getTags(m_fields[i])));
+	}
+	++m_size;
+}
+
+}
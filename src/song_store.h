@@ -0,0 +1,155 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#ifndef NCMPCPP_SONG_STORE_H
+#define NCMPCPP_SONG_STORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+
+#include "song.h"
+
+namespace MPD {
+
+// Table of unique strings stored back to back in a single buffer. Each string
+// is identified by its index, so equal strings are stored only once and can
+// be compared by their ids.
+struct StringPool
+{
+	typedef uint32_t Id;
+
+	StringPool();
+
+	StringPool(const StringPool &) = delete;
+	StringPool &operator=(const StringPool &) = delete;
+
+	Id intern(boost::string_ref s);
+
+	boost::string_ref get(Id id) const
+	{
+		return boost::string_ref(
+			m_data.data() + m_offsets[id], m_offsets[id+1] - m_offsets[id]);
+	}
+
+	size_t size() const { return m_offsets.size() - 1; }
+
+	// Position of each string in the order defined by cmp (which returns
+	// a negative value, zero or a positive value, like strcmp). Strings that
+	// compare equal get the same rank.
+	template <typename CompareT>
+	std::vector<Id> ranks(CompareT cmp) const
+	{
+		std::vector<Id> order(size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [this, &cmp](Id a, Id b) {
+			return cmp(get(a), get(b)) < 0;
+		});
+		std::vector<Id> result(size());
+		Id rank = 0;
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			if (i > 0 && cmp(get(order[i-1]), get(order[i])) != 0)
+				++rank;
+			result[order[i]] = rank;
+		}
+		return result;
+	}
+
+private:
+	struct Hash
+	{
+		Hash(const StringPool &pool) : m_pool(pool) { }
+		size_t operator()(Id id) const;
+	private:
+		const StringPool &m_pool;
+	};
+
+	struct Equal
+	{
+		Equal(const StringPool &pool) : m_pool(pool) { }
+		bool operator()(Id a, Id b) const { return m_pool.get(a) == m_pool.get(b); }
+	private:
+		const StringPool &m_pool;
+	};
+
+	std::vector<char> m_data;
+	std::vector<uint32_t> m_offsets;
+	std::unordered_set<Id, Hash, Equal> m_index;
+};
+
+// Compact, read-only view of a list of songs. Only the requested fields are
+// kept, as ids of interned strings laid out one column per field, which takes
+// a fraction of the memory of the songs themselves and makes comparing them
+// free of allocations.
+struct SongStore
+{
+	typedef std::vector<Song::GetFunction> Fields;
+
+	SongStore(Fields fields);
+
+	// Append a song. Multiple values of a tag are joined the same way as
+	// Song::getTags does it.
+	void add(const Song &s);
+
+	size_t size() const { return m_size; }
+	const Fields &fields() const { return m_fields; }
+	const StringPool &strings() const { return m_strings; }
+
+	StringPool::Id id(size_t song, size_t field) const
+	{
+		return m_columns[field][song];
+	}
+	boost::string_ref get(size_t song, size_t field) const
+	{
+		return m_strings.get(id(song, field));
+	}
+
+private:
+	Fields m_fields;
+	std::vector<Song::PeekFunction> m_peek_functions;
+	StringPool m_strings;
+	std::vector<std::vector<StringPool::Id>> m_columns;
+	size_t m_size;
+
+	std::string m_buffer;
+};
+
+// Rearrange elements of the range starting at first so that i-th element is
+// the one previously at position order[i].
+template <typename IteratorT>
+void reorder(IteratorT first, const std::vector<size_t> &order)
+{
+	typedef typename std::iterator_traits<IteratorT>::value_type ValueT;
+	std::vector<ValueT> tmp;
+	tmp.reserve(order.size());
+	for (size_t i : order)
+		tmp.push_back(std::move(first[i]));
+	std::move(tmp.begin(), tmp.end(), first);
+}
+
+}
+
+#endif // NCMPCPP_SONG_STORE_H
@@ -21,10 +21,12 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <netinet/tcp.h>
 #include <netinet/in.h>
+#include <unordered_map>
 
 #include "curses/menu_impl.h"
 #include "screens/browser.h"
 #include "charset.h"
+#include "database_cache.h"
 #include "format_impl.h"
 #include "global.h"
 #include "helpers.h"
@@ -136,6 +138,67 @@ std::string playerStateToString(MPD::PlayerState ps)
 	return result;
 }
 
+// Apply changes to the playlist knowing only positions and ids of changed
+// songs, so that songs that were only moved around (e.g. by shuffling) don't
+// need to be fetched again. Songs reported at their current position changed
+// in place and are fetched again. Returns false if nothing was done because most
+// of the changed songs are new and fetching all changes at once is cheaper.
+bool updatePlaylistByIds(unsigned previous_version)
+{
+	auto changes = Mpd.GetPlaylistChangesPosId(previous_version);
+	std::unordered_map<unsigned, MPD::Song> songs;
+	songs.reserve(myPlaylist->main().size());
+	for (const auto &item : myPlaylist->main())
+		songs.emplace(item.value().getID(), item.value());
+
+	// An id that is reported at the position it already occupies didn't move,
+	// so its metadata changed (e.g. stream title or priority) and the cached
+	// song is stale. Fetch it again along with the new ones.
+	std::vector<unsigned> new_ids;
+	for (const auto &change : changes)
+	{
+		auto it = songs.find(change.second);
+		if (it != songs.end() && it->second.getPosition() == change.first)
+			songs.erase(it);
+		if (songs.count(change.second) == 0)
+			new_ids.push_back(change.second);
+	}
+	if (new_ids.size() > changes.size()/2)
+		return false;
+
+	std::vector<MPD::Song> new_songs;
+	if (!new_ids.empty())
+	{
+		try
+		{
+			new_songs = Mpd.GetPlaylistSongs(new_ids);
+		}
+		catch (MPD::ServerError &)
+		{
+			// One of the songs was already removed, do a full update.
+			return false;
+		}
+		if (new_songs.size() != new_ids.size())
+			return false;
+	}
+
+	myPlaylist->truncate(m_playlist_length);
+	auto new_song = new_songs.begin();
+	for (const auto &change : changes)
+	{
+		auto it = songs.find(change.second);
+		if (it != songs.end())
+		{
+			MPD::Song s = std::move(it->second);
+			s.setPosition(change.first);
+			myPlaylist->setSong(change.first, std::move(s));
+		}
+		else
+			myPlaylist->setSong(change.first, std::move(*new_song++));
+	}
+	return true;
+}
+
 void initialize_status()
 {
 	// get full info about new connection
@@ -165,7 +228,6 @@ void initialize_status()
 #	ifdef ENABLE_VISUALIZER
 	myVisualizer->CloseDataSource();
 	myVisualizer->OpenDataSource();
-	myVisualizer->FindOutputID();
 #	endif // ENABLE_VISUALIZER
 
 	m_status_initialized = true;
@@ -239,6 +301,24 @@ void Status::trace(bool update_timer, bool update_window_timeout)
 			past = Timer;
 		}
 
+		try
+		{
+			MpdWorker.processResults();
+		}
+		catch (MPD::Error &e)
+		{
+			// Errors of the worker connection don't affect the main one.
+			Statusbar::printf("MPD: %1%", e.what());
+		}
+
+#		ifdef ENABLE_VISUALIZER
+		// Don't process samples while nobody can see them.
+		if (isVisible(myVisualizer))
+			myVisualizer->Resume();
+		else
+			myVisualizer->Suspend();
+#		endif // ENABLE_VISUALIZER
+
 		applyToVisibleWindows(&BaseScreen::update);
 		Statusbar::tryRedraw();
 
@@ -254,6 +334,8 @@ void Status::trace(bool update_timer, bool update_window_timeout)
 		});
 		wFooter->setTimeout(nc_wtimeout);
 	}
+	// Send out everything redrawn during this update at once.
+	NC::updateScreen();
 }
 
 void Status::update(int event)
@@ -431,29 +513,15 @@ void Status::Changes::playlist(unsigned previous_version)
 	{
 		ScopedUnfilteredMenu<MPD::Song> sunfilter(ReapplyFilter::Yes, myPlaylist->main());
 
-		if (m_playlist_length < myPlaylist->main().size())
-		{
-			auto it = myPlaylist->main().begin()+m_playlist_length;
-			auto end = myPlaylist->main().end();
-			for (; it != end; ++it)
-				myPlaylist->unregisterSong(it->value());
-			myPlaylist->main().resizeList(m_playlist_length);
-		}
-
-		MPD::SongIterator s = Mpd.GetPlaylistChanges(previous_version), end;
-		for (; s != end; ++s)
+		if (!updatePlaylistByIds(previous_version))
 		{
-			size_t pos = s->getPosition();
-			myPlaylist->registerSong(*s);
-			if (pos < myPlaylist->main().size())
+			myPlaylist->truncate(m_playlist_length);
+			MPD::SongIterator s = Mpd.GetPlaylistChanges(previous_version), end;
+			for (; s != end; ++s)
 			{
-				// if song's already in playlist, replace it with a new one
-				MPD::Song &old_s = myPlaylist->main()[pos].value();
-				myPlaylist->unregisterSong(old_s);
-				old_s = std::move(*s);
+				size_t pos = s->getPosition();
+				myPlaylist->setSong(pos, std::move(*s));
 			}
-			else // otherwise just add it to playlist
-				myPlaylist->main().addItem(std::move(*s));
 		}
 	}
 
@@ -482,6 +550,7 @@ void Status::Changes::storedPlaylists()
 
 void Status::Changes::database()
 {
+	DatabaseCache::invalidate();
 	myBrowser->requestUpdate();
 #	ifdef HAVE_TAGLIB_H
 	myTagEditor->Dirs->clear();
@@ -184,6 +184,8 @@ void Statusbar::print(int delay, const std::string &message)
             *wFooter << message << NC::TermManip::ClearToEOL;
         }
 		wFooter->refresh();
+		// Messages often precede blocking operations, show them immediately.
+		NC::updateScreen();
 	}
 }
 
@@ -223,16 +225,23 @@ bool Statusbar::Helpers::ImmediatelyReturnOneOf::operator()(const char *s) const
 bool Statusbar::Helpers::ApplyFilterImmediately::operator()(const char *s)
 {
 	using Global::myScreen;
+	using Global::wFooter;
 	Status::trace();
 	try {
 		if (m_w->allowsFiltering() && m_w->currentFilter() != s)
 		{
+			// If the constraint is about to change, there is no point in finishing
+			// the current pass, the hook will be run again with the new one.
+			NC::ScopedFilterInterruptHook interrupt_hook([] {
+				return wFooter->inputPending();
+			});
 			m_w->applyFilter(s);
 			if (myScreen == myPlaylist)
 				myPlaylist->enableHighlighting();
 			myScreen->refreshWindow();
 		}
-	} catch (boost::bad_expression &) { }
+	} catch (boost::bad_expression &) {
+	} catch (NC::FilterInterrupted &) { }
 	return true;
 }
 
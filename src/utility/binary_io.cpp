@@ -0,0 +1,84 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#include <algorithm>
+
+#include "utility/binary_io.h"
+
+void writeNumber(std::ostream &os, uint64_t n)
+{
+	while (n >= 0x80)
+	{
+		os.put(static_cast<char>((n & 0x7f) | 0x80));
+		n >>= 7;
+	}
+	os.put(static_cast<char>(n));
+}
+
+bool readNumber(std::istream &is, uint64_t &n)
+{
+	n = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7)
+	{
+		int c = is.get();
+		if (c == std::char_traits<char>::eof())
+			return false;
+		n |= uint64_t(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+void writeString(std::ostream &os, const std::string &s)
+{
+	writeNumber(os, s.size());
+	os.write(s.data(), s.size());
+}
+
+bool readString(std::istream &is, std::string &s)
+{
+	// Sizes read from corrupted data can't be trusted, so long strings are read
+	// in chunks. Memory is then never allocated beyond what is actually in the
+	// stream.
+	const uint64_t chunk_size = 1 << 16;
+	uint64_t size;
+	if (!readNumber(is, size))
+		return false;
+	s.clear();
+	while (s.size() < size)
+	{
+		size_t offset = s.size();
+		size_t n = std::min(chunk_size, size - offset);
+		s.resize(offset + n);
+		if (!is.read(&s[offset], n))
+			return false;
+	}
+	return true;
+}
+
+bool skipString(std::istream &is)
+{
+	uint64_t size;
+	if (!readNumber(is, size))
+		return false;
+	is.ignore(size);
+	return uint64_t(is.gcount()) == size;
+}
@@ -0,0 +1,39 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#ifndef NCMPCPP_UTILITY_BINARY_IO_H
+#define NCMPCPP_UTILITY_BINARY_IO_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Integers are stored as LEB128 varints, strings are prefixed with their
+// length. Reading functions return false if the data is truncated.
+
+void writeNumber(std::ostream &os, uint64_t n);
+bool readNumber(std::istream &is, uint64_t &n);
+
+void writeString(std::ostream &os, const std::string &s);
+bool readString(std::istream &is, std::string &s);
+bool skipString(std::istream &is);
+
+#endif // NCMPCPP_UTILITY_BINARY_IO_H
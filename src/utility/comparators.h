@@ -22,6 +22,7 @@
 #define NCMPCPP_UTILITY_COMPARATORS_H
 
 #include <string>
+#include <boost/utility/string_ref.hpp>
 #include "runnable_item.h"
 #include "mpdpp.h"
 #include "settings.h"
@@ -42,6 +43,9 @@ public:
 	int operator()(const std::string &a, const std::string &b) const {
 		return compare(a.c_str(), a.length(), b.c_str(), b.length());
 	}
+	int operator()(boost::string_ref a, boost::string_ref b) const {
+		return compare(a.data(), a.length(), b.data(), b.length());
+	}
 
 	int compare(const char *a, size_t a_len, const char *b, size_t b_len) const;
 };
@@ -62,7 +66,8 @@ public:
 	}
 
 	bool operator()(const MPD::Song &a, const MPD::Song &b) const {
-		return m_cmp(a.getName(), b.getName()) < 0;
+		std::string a_buffer, b_buffer;
+		return m_cmp(a.peekName(0, a_buffer), b.peekName(0, b_buffer)) < 0;
 	}
 	
 	template <typename A, typename B>
@@ -0,0 +1,96 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#ifndef NCMPCPP_UTILITY_FENWICK_TREE_H
+#define NCMPCPP_UTILITY_FENWICK_TREE_H
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Sequence of values that supports changing a value and computing the sum of
+// a prefix of the sequence in O(log n).
+template <typename ValueT>
+struct FenwickTree
+{
+	FenwickTree()
+	: m_tree(1, ValueT())
+	{ }
+
+	size_t size() const
+	{
+		return m_values.size();
+	}
+
+	const ValueT &operator[](size_t i) const
+	{
+		return m_values[i];
+	}
+
+	void push_back(ValueT value)
+	{
+		// New node covers a range of preceding values, take their sum.
+		size_t node = m_tree.size();
+		m_tree.push_back(value + prefixSum(node-1) - prefixSum(node - (node & -node)));
+		m_values.push_back(std::move(value));
+	}
+
+	void resize(size_t size)
+	{
+		// Nodes only cover values before them, so truncating is enough.
+		if (size < m_values.size())
+		{
+			m_tree.resize(size+1);
+			m_values.resize(size);
+		}
+		while (m_values.size() < size)
+			push_back(ValueT());
+	}
+
+	void set(size_t i, ValueT value)
+	{
+		assert(i < m_values.size());
+		ValueT delta = value - m_values[i];
+		m_values[i] = std::move(value);
+		for (++i; i < m_tree.size(); i += i & -i)
+			m_tree[i] += delta;
+	}
+
+	// Sum of the first n values.
+	ValueT prefixSum(size_t n) const
+	{
+		assert(n <= m_values.size());
+		ValueT result = ValueT();
+		for (; n > 0; n -= n & -n)
+			result += m_tree[n];
+		return result;
+	}
+
+	ValueT sum() const
+	{
+		return prefixSum(m_values.size());
+	}
+
+private:
+	std::vector<ValueT> m_tree;
+	std::vector<ValueT> m_values;
+};
+
+#endif // NCMPCPP_UTILITY_FENWICK_TREE_H
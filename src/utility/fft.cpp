@@ -0,0 +1,65 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#include "utility/fft.h"
+
+#ifdef HAVE_FFTW3_H
+
+#include <algorithm>
+
+#ifdef HAVE_FFTW3F
+# define FFTW(name) fftwf_ ## name
+#else
+# define FFTW(name) fftw_ ## name
+#endif // HAVE_FFTW3F
+
+RealFFT::RealFFT(size_t size, const std::string &wisdom_path)
+: m_size(size)
+{
+	m_input = FFTW(alloc_real)(m_size);
+	m_output = FFTW(alloc_complex)(outputSize());
+
+	FFTW(import_wisdom_from_filename)(wisdom_path.c_str());
+	m_plan = FFTW(plan_dft_r2c_1d)(m_size, m_input, m_output,
+	                               FFTW_MEASURE | FFTW_WISDOM_ONLY);
+	if (m_plan == nullptr)
+	{
+		// No wisdom for this size yet. Measuring takes a while, so save the
+		// results for later.
+		m_plan = FFTW(plan_dft_r2c_1d)(m_size, m_input, m_output, FFTW_MEASURE);
+		FFTW(export_wisdom_to_filename)(wisdom_path.c_str());
+	}
+
+	std::fill(m_input, m_input + m_size, Real(0));
+}
+
+RealFFT::~RealFFT()
+{
+	FFTW(destroy_plan)(m_plan);
+	FFTW(free)(m_output);
+	FFTW(free)(m_input);
+}
+
+void RealFFT::execute()
+{
+	FFTW(execute)(m_plan);
+}
+
+#endif // HAVE_FFTW3_H
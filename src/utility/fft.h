@@ -0,0 +1,72 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#ifndef NCMPCPP_UTILITY_FFT_H
+#define NCMPCPP_UTILITY_FFT_H
+
+#include "config.h"
+
+#ifdef HAVE_FFTW3_H
+
+#include <cstddef>
+#include <string>
+#include <fftw3.h>
+
+// Real to complex DFT of a fixed size. Single precision version of fftw is
+// used if it's available. Plans are measured instead of estimated and the
+// accumulated wisdom is kept in a file, so that measuring happens only once.
+struct RealFFT
+{
+#	ifdef HAVE_FFTW3F
+	typedef float Real;
+	typedef fftwf_complex Complex;
+	typedef fftwf_plan Plan;
+#	else
+	typedef double Real;
+	typedef fftw_complex Complex;
+	typedef fftw_plan Plan;
+#	endif // HAVE_FFTW3F
+
+	// Measuring overwrites input and output arrays, so the transform has to be
+	// constructed before the input is filled. Input is zero initialized.
+	RealFFT(size_t size, const std::string &wisdom_path);
+	~RealFFT();
+
+	RealFFT(const RealFFT &) = delete;
+	RealFFT &operator=(const RealFFT &) = delete;
+
+	size_t inputSize() const { return m_size; }
+	size_t outputSize() const { return m_size/2 + 1; }
+
+	Real *input() { return m_input; }
+	const Complex *output() const { return m_output; }
+
+	void execute();
+
+private:
+	size_t m_size;
+	Real *m_input;
+	Complex *m_output;
+	Plan m_plan;
+};
+
+#endif // HAVE_FFTW3_H
+
+#endif // NCMPCPP_UTILITY_FFT_H
@@ -22,6 +22,7 @@
 #define NCMPCPP_UTILITY_FUNCTIONAL_H
 
 #include <boost/locale/encoding_utf.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <utility>
 
 /// Map over the first element in range satisfying the predicate.
@@ -52,6 +53,10 @@ struct convertString
 	{
 		return boost::locale::conv::utf_to_utf<TargetT>(s);
 	}
+	static std::basic_string<TargetT> apply(boost::basic_string_ref<SourceT> s)
+	{
+		return boost::locale::conv::utf_to_utf<TargetT>(s.begin(), s.end());
+	}
 };
 template <typename TargetT>
 struct convertString<TargetT, TargetT>
@@ -60,6 +65,10 @@ struct convertString<TargetT, TargetT>
 	{
 		return s;
 	}
+	static std::basic_string<TargetT> apply(boost::basic_string_ref<TargetT> s)
+	{
+		return std::basic_string<TargetT>(s.begin(), s.end());
+	}
 };
 
 
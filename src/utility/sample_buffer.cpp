@@ -18,76 +18,95 @@
  *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
  ***************************************************************************/
 
-#include <stdexcept>
+#include <algorithm>
 
 #include "utility/sample_buffer.h"
 
-void SampleBuffer::put(SampleBuffer::Iterator begin, SampleBuffer::Iterator end)
+SampleBuffer::SampleBuffer()
+: m_mask(0)
+, m_history(0)
+, m_read(0)
+, m_write(0)
+, m_overflow(false)
+{ }
+
+size_t SampleBuffer::put(const int16_t *begin, const int16_t *end)
 {
-	size_t elems = end - begin;
-	if (elems > m_buffer.size())
-		throw std::out_of_range("Size of the buffer is smaller than the amount of elements");
+	size_t write = m_write.load(std::memory_order_relaxed);
+	size_t read = m_read.load(std::memory_order_acquire);
 
-	size_t free_elems = m_buffer.size() - m_offset;
-	if (elems > free_elems)
+	// Part of the buffer after the history is available.
+	size_t free_elems = m_buffer.size() - m_history - (write - read);
+	if (size_t(end - begin) > free_elems)
 	{
-		size_t to_remove = elems - free_elems;
-		std::copy(m_buffer.begin() + to_remove, m_buffer.end() - free_elems,
-		          m_buffer.begin());
-		m_offset -= to_remove;
+		begin = end - free_elems;
+		m_overflow.store(true, std::memory_order_relaxed);
 	}
-	std::copy(begin, end, m_buffer.begin() + m_offset);
-	m_offset += elems;
-}
+	size_t elems = end - begin;
 
-size_t SampleBuffer::get(size_t elems, std::vector<int16_t> &dest)
-{
-	if (m_offset == 0)
-		return 0;
+	size_t offset = write & m_mask;
+	size_t first_part = std::min(elems, m_buffer.size() - offset);
+	std::copy(begin, begin + first_part, m_buffer.begin() + offset);
+	std::copy(begin + first_part, end, m_buffer.begin());
 
-	// If the amount of requested samples is bigger than available, return only
-	// available.
-	if (elems > m_offset)
-		elems = m_offset;
+	m_write.store(write + elems, std::memory_order_release);
+	return elems;
+}
 
-	if (elems >= dest.size())
-	{
-		// If dest is smaller than the available amount of samples, discard the
-		// ones that come first.
-		size_t elems_lost = elems - dest.size();
-		std::copy(m_buffer.begin() + elems_lost, m_buffer.begin() + elems, dest.begin());
-	}
-	else
-	{
-		// Copy samples to the destination buffer.
-		std::copy(dest.begin() + elems, dest.end(), dest.begin());
-		std::copy(m_buffer.begin(), m_buffer.begin() + elems, dest.end() - elems);
-	}
+size_t SampleBuffer::get(size_t elems)
+{
+	size_t write = m_write.load(std::memory_order_acquire);
+	size_t read = m_read.load(std::memory_order_relaxed);
 
-	// Remove them from the internal buffer.
-	std::copy(m_buffer.begin() + elems, m_buffer.begin() + m_offset, m_buffer.begin());
-	m_offset -= elems;
+	size_t available = write - read;
+	// If the producer had to drop samples, we are lagging behind. Skip to the
+	// most recent ones then.
+	if (m_overflow.exchange(false, std::memory_order_relaxed) && available > elems)
+		read = write - elems;
+	else if (elems > available)
+		elems = available;
 
+	m_read.store(read + elems, std::memory_order_release);
 	return elems;
 }
 
-void SampleBuffer::resize(size_t n)
+void SampleBuffer::clear()
 {
-	m_buffer.resize(n);
-	clear();
+	size_t write = m_write.load(std::memory_order_acquire);
+
+	// Producer writes past the current write position and before the start of
+	// the history, so it won't touch the part we zero.
+	size_t offset = (write - m_history) & m_mask;
+	size_t first_part = std::min(m_history, m_buffer.size() - offset);
+	std::fill(m_buffer.begin() + offset, m_buffer.begin() + offset + first_part, 0);
+	std::fill(m_buffer.begin(), m_buffer.begin() + m_history - first_part, 0);
+
+	m_overflow.store(false, std::memory_order_relaxed);
+	m_read.store(write, std::memory_order_release);
 }
 
-void SampleBuffer::clear()
+void SampleBuffer::resize(size_t n, size_t history)
 {
-	m_offset = 0;
+	size_t capacity = 1;
+	while (capacity < n + history)
+		capacity *= 2;
+	m_buffer.assign(capacity, 0);
+	m_mask = capacity - 1;
+	m_history = history;
+	m_read = 0;
+	m_write = 0;
+	m_overflow = false;
 }
 
 size_t SampleBuffer::size() const
 {
-	return m_offset;
+	return m_write.load(std::memory_order_acquire)
+		- m_read.load(std::memory_order_relaxed);
 }
 
-const std::vector<int16_t> &SampleBuffer::buffer() const
+SampleBuffer::View SampleBuffer::history(size_t channel, size_t channels) const
 {
-	return m_buffer;
+	size_t read = m_read.load(std::memory_order_relaxed);
+	return View(m_buffer.data(), m_mask, read - m_history + channel, channels,
+	            m_history / channels);
 }
@@ -21,27 +21,74 @@
 #ifndef NCMPCPP_SAMPLE_BUFFER_H
 #define NCMPCPP_SAMPLE_BUFFER_H
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
+// Lock-free ring buffer of samples for a single producer and a single
+// consumer. Consumed samples are not discarded right away, the most recent
+// ones (history) are kept in the buffer and can be accessed through views
+// without copying them.
 struct SampleBuffer
 {
-	typedef std::vector<int16_t>::iterator Iterator;
+	// Read-only view of every stride-th sample of a part of the buffer.
+	struct View
+	{
+		View(const int16_t *data, size_t mask, size_t start, size_t stride, size_t size)
+		: m_data(data), m_mask(mask), m_start(start), m_stride(stride), m_size(size)
+		{ }
 
-	SampleBuffer() : m_offset(0) { }
+		int16_t operator[](size_t i) const
+		{
+			return m_data[(m_start + i*m_stride) & m_mask];
+		}
 
-	void put(Iterator begin, Iterator end);
-	size_t get(size_t elems, std::vector<int16_t> &dest);
+		size_t size() const { return m_size; }
 
-	void resize(size_t n);
+	private:
+		const int16_t *m_data;
+		size_t m_mask;
+		size_t m_start;
+		size_t m_stride;
+		size_t m_size;
+	};
+
+	SampleBuffer();
+
+	// Producer: append samples and return the number of the ones that fit. If
+	// not all of them do, the oldest are dropped and consumer skips to the most
+	// recent ones on the next call to get().
+	size_t put(const int16_t *begin, const int16_t *end);
+
+	// Consumer: consume at most elems samples, moving them to the history.
+	// Returns the number of consumed samples.
+	size_t get(size_t elems);
+
+	// Consumer: discard buffered samples and fill the history with silence.
 	void clear();
 
+	// Neither producer nor consumer can be active: allocate space for at least n
+	// buffered samples and the history of given size.
+	void resize(size_t n, size_t history);
+
+	// Number of buffered samples.
 	size_t size() const;
-	const std::vector<int16_t> &buffer() const;
+
+	// Consumer: view of a channel of the history of interleaved samples. It's
+	// valid until the next call to get() or clear().
+	View history(size_t channel = 0, size_t channels = 1) const;
 
 private:
-	size_t m_offset;
 	std::vector<int16_t> m_buffer;
+	size_t m_mask;
+	size_t m_history;
+
+	// Total number of samples ever consumed and produced respectively, their
+	// difference is the number of buffered samples.
+	std::atomic<size_t> m_read;
+	std::atomic<size_t> m_write;
+	std::atomic<bool> m_overflow;
 };
 
 #endif // NCMPCPP_SAMPLE_BUFFER_H
@@ -0,0 +1,119 @@
+/***************************************************************************
+ *   Copyright (C) 2008-2021 by Andrzej Rybczak                            *
+ *   andrzej@rybczak.net                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.              *
+ ***************************************************************************/
+
+#ifndef NCMPCPP_UTILITY_THREAD_POOL_H
+#define NCMPCPP_UTILITY_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Set of worker threads for splitting CPU heavy work into independent tasks.
+struct ThreadPool
+{
+	typedef std::function<void()> Task;
+
+	ThreadPool(size_t threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	size_t size() const { return m_threads.size(); }
+
+	// Run the task on one of the worker threads (or on the calling thread if
+	// there are none). Returned future becomes ready once it's finished.
+	std::future<void> submit(Task task);
+
+	// Call f(begin, end) for consecutive chunks of [0, size) in parallel, with
+	// the calling thread taking part in the work. After each chunk processed by
+	// the calling thread, interrupted() is checked and if it returns true, the
+	// remaining chunks are skipped. Returns true if all chunks were processed.
+	template <typename FunctionT, typename InterruptT>
+	bool forEachChunk(size_t size, size_t chunk_size, FunctionT &&f,
+	                  InterruptT &&interrupted);
+
+	// Pool shared by the whole program, with a thread for each additional core.
+	static ThreadPool &instance();
+
+private:
+	void run();
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::queue<std::packaged_task<void()>> m_tasks;
+	std::vector<std::thread> m_threads;
+	bool m_stop;
+};
+
+template <typename FunctionT, typename InterruptT>
+bool ThreadPool::forEachChunk(size_t size, size_t chunk_size, FunctionT &&f,
+                              InterruptT &&interrupted)
+{
+	size_t chunks = (size + chunk_size - 1) / chunk_size;
+	std::atomic<size_t> next(0), done(0);
+	std::atomic<bool> stop(false);
+	auto process = [&](size_t chunk) {
+		f(chunk*chunk_size, std::min(size, (chunk+1)*chunk_size));
+		++done;
+	};
+	auto work = [&] {
+		for (size_t chunk; !stop && (chunk = next++) < chunks;)
+			process(chunk);
+	};
+
+	std::vector<std::future<void>> workers;
+	auto wait = [&workers] {
+		for (auto &worker : workers)
+			worker.wait();
+	};
+	try
+	{
+		size_t threads = chunks > 0 ? std::min(this->size(), chunks-1) : 0;
+		for (size_t i = 0; i < threads; ++i)
+			workers.push_back(submit(work));
+		for (size_t chunk; !stop && (chunk = next++) < chunks;)
+		{
+			process(chunk);
+			if (interrupted())
+				stop = true;
+		}
+	}
+	catch (...)
+	{
+		// Workers refer to local variables, they need to finish first.
+		stop = true;
+		wait();
+		throw;
+	}
+	wait();
+	// Rethrow exceptions thrown in worker threads.
+	for (auto &worker : workers)
+		worker.get();
+	return done == chunks;
+}
+
+#endif // NCMPCPP_UTILITY_THREAD_POOL_H